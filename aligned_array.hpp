@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+// Heap array of trivial elements starting on a cache line, sized at runtime.
+// Elements are left uninitialized, resize() drops the contents.
+template<typename T>
+class aligned_array
+{
+	static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "aligned_array elements are never constructed");
+
+public:
+	static const size_t ALIGN = 64;
+
+	aligned_array() = default;
+
+	explicit aligned_array(size_t n)
+	{
+		resize(n);
+	}
+
+	~aligned_array()
+	{
+		std::free(items);
+	}
+
+	aligned_array(const aligned_array &) = delete;
+	aligned_array &operator=(const aligned_array &) = delete;
+
+	void resize(size_t n)
+	{
+		std::free(items);
+		items = nullptr;
+		count = n;
+		if (n == 0) return;
+
+		// aligned_alloc wants the size to be a multiple of the alignment
+		items = (T *)std::aligned_alloc(ALIGN, (n * sizeof(T) + ALIGN - 1) / ALIGN * ALIGN);
+		if (items == nullptr) throw std::bad_alloc();
+	}
+
+	void fill(const T &value)
+	{
+		for (size_t i = 0; i < count; i++) items[i] = value;
+	}
+
+	T *data() { return items; }
+	const T *data() const { return items; }
+	size_t size() const { return count; }
+
+	T &operator[](size_t i) { return items[i]; }
+	const T &operator[](size_t i) const { return items[i]; }
+
+	T *begin() { return items; }
+	T *end() { return items + count; }
+	const T *begin() const { return items; }
+	const T *end() const { return items + count; }
+
+private:
+	T *items = nullptr;
+	size_t count = 0;
+};
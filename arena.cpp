@@ -0,0 +1,87 @@
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <algorithm>
+
+#include "arena.hpp"
+
+void *FrameArena::allocate(size_t size, size_t align)
+{
+	uintptr_t base = (uintptr_t)block.get();
+	uintptr_t aligned = (base + offset + align - 1) & ~(uintptr_t)(align - 1);
+	if (aligned + size <= base + capacity)
+	{
+		offset = aligned + size - base;
+		return (void *)aligned;
+	}
+
+	// grow right away to twice the high water mark, the rest of this frame and the next
+	// ones fit without touching the heap. new[] is aligned for any fundamental type.
+	retired_size += offset;
+	retired.push_back(std::move(block));
+	capacity = std::max(capacity, retired_size + size) * 2;
+	block.reset(new unsigned char[capacity]);
+	offset = size;
+	return block.get();
+}
+
+void FrameArena::reset()
+{
+	retired.clear();
+	retired_size = 0;
+	offset = 0;
+}
+
+#ifndef NDEBUG
+
+namespace
+{
+	std::atomic<size_t> allocation_count{0};
+}
+
+size_t heap_allocations()
+{
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+// count every allocation to prove the frame loop stays off the heap
+void *operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+#else
+
+size_t heap_allocations()
+{
+	return 0;
+}
+
+#endif
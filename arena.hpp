@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+// Bump allocator for data that lives for a single frame, reset() releases everything at once.
+// An allocation that does not fit retires the block and continues in one twice as large,
+// reset() keeps the newest block, so only the frames that grow the arena reach the heap.
+class FrameArena
+{
+public:
+	FrameArena(size_t capacity = 1 << 20) : block(new unsigned char[capacity]), capacity(capacity)
+	{
+	}
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+
+	void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+	template<typename T>
+	T *allocate(size_t n)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+		return (T *)allocate(n * sizeof(T), alignof(T));
+	}
+
+	// Extends the most recent allocation in place, fails if anything was allocated after it
+	bool grow(void *ptr, size_t size, size_t new_size)
+	{
+		unsigned char *p = (unsigned char *)ptr;
+		if (p + size != block.get() + offset || p + new_size > block.get() + capacity) return false;
+
+		offset = p + new_size - block.get();
+		return true;
+	}
+
+	void reset();
+
+	// bytes handed out since the last reset
+	size_t used() const
+	{
+		return offset + retired_size;
+	}
+
+private:
+	std::unique_ptr<unsigned char[]> block;
+	size_t capacity;
+	size_t offset = 0;
+
+	// outgrown blocks still referenced by this frame, freed on reset
+	std::vector<std::unique_ptr<unsigned char[]>> retired;
+	size_t retired_size = 0;
+};
+
+// Growable array of trivially copyable elements allocated from a FrameArena,
+// only valid until the arena is reset
+template<typename T>
+class frame_vector
+{
+	static_assert(std::is_trivially_copyable<T>::value, "frame_vector elements are moved with memcpy");
+
+public:
+	frame_vector(FrameArena &arena, size_t capacity = 64) : arena(arena), items(arena.allocate<T>(capacity)), capacity(capacity)
+	{
+	}
+
+	void push_back(const T &item)
+	{
+		if (count == capacity) reserve(capacity * 2);
+		items[count++] = item;
+	}
+
+	void reserve(size_t new_capacity)
+	{
+		if (new_capacity <= capacity) return;
+
+		if (!arena.grow(items, capacity * sizeof(T), new_capacity * sizeof(T)))
+		{
+			T *moved = arena.allocate<T>(new_capacity);
+			std::memcpy((void *)moved, items, count * sizeof(T));
+			items = moved;
+		}
+		capacity = new_capacity;
+	}
+
+	void clear()
+	{
+		count = 0;
+	}
+
+	T *data() { return items; }
+	const T *data() const { return items; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T &operator[](size_t i) { return items[i]; }
+	const T &operator[](size_t i) const { return items[i]; }
+
+	T *begin() { return items; }
+	T *end() { return items + count; }
+	const T *begin() const { return items; }
+	const T *end() const { return items + count; }
+
+private:
+	FrameArena &arena;
+	T *items;
+	size_t count = 0;
+	size_t capacity;
+};
+
+// Number of operator new calls so far, always 0 when built with NDEBUG
+size_t heap_allocations();
@@ -1,7 +1,8 @@
 #pragma once
 
-#define WIDTH 800
-#define HEIGHT 640
+// output resolution unless given on the command line
+#define DEFAULT_WIDTH 800
+#define DEFAULT_HEIGHT 640
 
 #define for_range(it, n, k) for (int it = n; it < k; it++)
 
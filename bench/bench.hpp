@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "base.hpp"
+
+// work done by one pass of a benchmark, for the throughput columns
+struct bench_work {
+	uint64_t triangles = 0;
+	uint64_t pixels = 0;
+};
+
+// Deterministic generator, same inputs on every machine and standard library
+struct bench_random {
+	uint32_t state;
+
+	bench_random(uint32_t seed = 12345) : state(seed)
+	{
+	}
+
+	// xorshift32
+	uint32_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	float uniform(float lo, float hi)
+	{
+		return lo + (hi - lo) * (float)(next() >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+// Times passes over a fixed input set and prints one CSV row per benchmark:
+// name,ops,ns_per_op,triangles_per_s,pixels_per_s. Rates come from the fastest pass,
+// the least disturbed by the rest of the machine.
+class BenchRunner
+{
+public:
+	BenchRunner(double min_seconds = 0.25, const char *filter = nullptr) : min_seconds(min_seconds), filter(filter)
+	{
+	}
+
+	static void header()
+	{
+		std::printf("name,ops,ns_per_op,triangles_per_s,pixels_per_s\n");
+	}
+
+	bool wanted(const char *name) const
+	{
+		return filter == nullptr || std::strstr(name, filter) != nullptr;
+	}
+
+	// pass() runs ops operations and returns the work they did, reset() restores the
+	// inputs between passes and is not timed
+	template<typename Pass, typename Reset>
+	void run(const char *name, uint64_t ops, Pass &&pass, Reset &&reset)
+	{
+		if (!wanted(name)) return;
+		using clock = std::chrono::steady_clock;
+
+		// warm up caches and lazily built state
+		reset();
+		bench_work work = pass();
+
+		double best = 0.0, total = 0.0;
+		int passes = 0;
+		while (total < min_seconds || passes < 3)
+		{
+			reset();
+			const auto start = clock::now();
+			work = pass();
+			const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+			best = passes == 0 ? seconds : std::min(best, seconds);
+			total += seconds;
+			passes++;
+		}
+
+		std::printf("%s,%llu,%.3f,%.0f,%.0f\n", name, (unsigned long long)ops, best * 1e9 / ops,
+			work.triangles / best, work.pixels / best);
+		std::fflush(stdout);
+	}
+
+	template<typename Pass>
+	void run(const char *name, uint64_t ops, Pass &&pass)
+	{
+		run(name, ops, pass, [] {});
+	}
+
+private:
+	double min_seconds;
+	const char *filter;
+};
+
+// keeps results alive so the compiler can't drop the measured work
+extern volatile uint64_t bench_sink;
+
+void bench_math(BenchRunner &runner);
+void bench_clip(BenchRunner &runner);
+void bench_raster(BenchRunner &runner);
+void bench_mesh(BenchRunner &runner);
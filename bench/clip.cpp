@@ -0,0 +1,69 @@
+#include <vector>
+
+#include "bench.hpp"
+#include "triangle.hpp"
+
+namespace
+{
+	// clip space triangle around the near plane, so about half of them get cut
+	triangle random_triangle(bench_random &random)
+	{
+		triangle t;
+		for_range(i, 0, 3)
+		{
+			const float w = random.uniform(0.5f, 4.0f);
+			t.vs[i] = {random.uniform(-1.5f, 1.5f) * w, random.uniform(-1.5f, 1.5f) * w, random.uniform(-0.5f, 1.0f) * w, w};
+			t.ts[i] = {random.uniform(0.0f, 1.0f), random.uniform(0.0f, 1.0f), 1.0f};
+		}
+		return t;
+	}
+}
+
+void bench_clip(BenchRunner &runner)
+{
+	bench_random random;
+
+	const int n = 4096;
+	std::vector<triangle> ts(n);
+	for (auto &t : ts) t = random_triangle(random);
+
+	runner.run("clip_plane", n, [&]
+	{
+		bench_work work;
+		for_range(i, 0, n)
+		{
+			triangle in = ts[i], out[2];
+			work.triangles += triangle::clip_plane({0.0f, 0.0f, 0.5f}, {0.0f, 0.0f, 1.0f}, in, out[0], out[1]);
+		}
+		bench_sink = bench_sink + work.triangles;
+		// throughput counts input triangles
+		work.triangles = n;
+		return work;
+	});
+
+	runner.run("clip_frustum", n, [&]
+	{
+		bench_work work;
+		for_range(i, 0, n)
+		{
+			triangle out[triangle::CLIP_MAX];
+			work.triangles += triangle::clip_frustum(ts[i], out);
+		}
+		bench_sink = bench_sink + work.triangles;
+		work.triangles = n;
+		return work;
+	});
+
+	runner.run("clip_frustum_guard_band", n, [&]
+	{
+		bench_work work;
+		for_range(i, 0, n)
+		{
+			triangle out[triangle::CLIP_MAX];
+			work.triangles += triangle::clip_frustum(ts[i], out, 11.0f, 13.0f);
+		}
+		bench_sink = bench_sink + work.triangles;
+		work.triangles = n;
+		return work;
+	});
+}
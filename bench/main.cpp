@@ -0,0 +1,46 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+#include "bench.hpp"
+
+volatile uint64_t bench_sink = 0;
+
+static void usage(const char *name)
+{
+	std::cerr << "Usage: " << name << " [--min-time <s>] [filter]" << std::endl;
+	std::cerr << "  --min-time <s>  time every benchmark for at least s seconds, default 0.25" << std::endl;
+	std::cerr << "  filter          only run benchmarks whose name contains it" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+	double min_seconds = 0.25;
+	const char *filter = nullptr;
+
+	for (int arg = 1; arg < argc; arg++)
+	{
+		if (!strcmp(argv[arg], "--min-time") && arg + 1 < argc)
+		{
+			min_seconds = atof(argv[++arg]);
+		}
+		else if (argv[arg][0] != '-' && filter == nullptr)
+		{
+			filter = argv[arg];
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	BenchRunner runner(min_seconds, filter);
+	BenchRunner::header();
+
+	bench_math(runner);
+	bench_clip(runner);
+	bench_raster(runner);
+	bench_mesh(runner);
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <vector>
+
+#include "bench.hpp"
+#include "mat4.hpp"
+#include "stream.hpp"
+
+namespace
+{
+	mat4 random_matrix(bench_random &random)
+	{
+		mat4 m;
+		for_range(row, 0, 4)
+		{
+			for_range(col, 0, 4) m.m[row][col] = random.uniform(-1.0f, 1.0f);
+		}
+		return m;
+	}
+
+	vec3 random_point(bench_random &random)
+	{
+		return {random.uniform(-10.0f, 10.0f), random.uniform(-10.0f, 10.0f), random.uniform(-10.0f, 10.0f)};
+	}
+}
+
+void bench_math(BenchRunner &runner)
+{
+	bench_random random;
+
+	const int n = 1024;
+	std::vector<mat4> as(n), bs(n);
+	std::vector<vec3> points(n);
+	for_range(i, 0, n)
+	{
+		as[i] = random_matrix(random);
+		bs[i] = random_matrix(random);
+		points[i] = random_point(random);
+	}
+
+	runner.run("mat4_mul", n, [&]
+	{
+		float sum = 0.0f;
+		for_range(i, 0, n)
+		{
+			const mat4 c = as[i] * bs[i];
+			sum += c.m[i & 3][(i >> 2) & 3];
+		}
+		bench_sink = bench_sink + (uint64_t)sum;
+		return bench_work{};
+	});
+
+	mat4 mvp = mat4::projection(90.0f, 0.8f, 0.1f, 1000.0f);
+	runner.run("mat4_mul_vec3", n, [&]
+	{
+		float sum = 0.0f;
+		for_range(i, 0, n) sum += (mvp * points[i]).w;
+		bench_sink = bench_sink + (uint64_t)sum;
+		return bench_work{};
+	});
+
+	// the clip space transform of the frame, one op per point
+	const int stream_n = 1 << 16;
+	vec3_stream in;
+	for_range(i, 0, stream_n) in.push_back(random_point(random));
+	vec4_stream out;
+	out.resize(stream_n);
+
+	runner.run("mat4_transform_points", stream_n, [&]
+	{
+		mvp.transform(in, out, 0, in.size());
+		bench_sink = bench_sink + (uint64_t)out.w[stream_n / 2];
+		return bench_work{};
+	});
+}
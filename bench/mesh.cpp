@@ -0,0 +1,72 @@
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "bench.hpp"
+#include "mesh.hpp"
+
+namespace
+{
+	// UV sphere with texture coordinates, 2 * rings * segments triangles
+	bool write_sphere(const std::string &path, int rings, int segments)
+	{
+		std::ofstream out(path);
+		if (!out) return false;
+
+		for_range(r, 0, rings + 1)
+		{
+			const float theta = (float)r / rings * (float)PI;
+			for_range(s, 0, segments + 1)
+			{
+				const float phi = (float)s / segments * 2.0f * (float)PI;
+				out << "v " << sinf(theta) * cosf(phi) << " " << cosf(theta) << " " << sinf(theta) * sinf(phi) << "\n";
+				out << "vt " << (float)s / segments << " " << 1.0f - (float)r / rings << "\n";
+			}
+		}
+
+		auto index = [&](int r, int s) { return r * (segments + 1) + s + 1; };
+		for_range(r, 0, rings)
+		{
+			for_range(s, 0, segments)
+			{
+				const int a = index(r, s), b = index(r + 1, s), c = index(r + 1, s + 1), d = index(r, s + 1);
+				out << "f " << a << "/" << a << " " << b << "/" << b << " " << c << "/" << c << "\n";
+				out << "f " << a << "/" << a << " " << c << "/" << c << " " << d << "/" << d << "\n";
+			}
+		}
+		return (bool)out;
+	}
+}
+
+void bench_mesh(BenchRunner &runner)
+{
+	if (!runner.wanted("mesh_load")) return;
+
+	const char *tmp = getenv("TMPDIR");
+	const std::string path = std::string(tmp != nullptr ? tmp : "/tmp") + "/gl3d_bench_" + std::to_string(getpid()) + ".obj";
+	const std::string cache_path = path + ".tex.cache";
+
+	// 131072 triangles
+	if (!write_sphere(path, 256, 256))
+	{
+		std::fprintf(stderr, "Unable to write %s\n", path.c_str());
+		return;
+	}
+
+	auto load = [&](bool use_cache)
+	{
+		mesh m;
+		if (!m.load_from_file(path.c_str(), true, use_cache)) return bench_work{};
+		return bench_work{m.triangle_count(), 0};
+	};
+
+	runner.run("mesh_load_obj", 1, [&] { return load(false); });
+
+	// the first load writes the cache, the warm up pass of the runner
+	runner.run("mesh_load_cache", 1, [&] { return load(true); });
+
+	std::remove(cache_path.c_str());
+	std::remove(path.c_str());
+}
@@ -0,0 +1,119 @@
+#include <vector>
+#include <string>
+
+#include "bench.hpp"
+#include "render.hpp"
+#include "texture.hpp"
+
+namespace
+{
+	const int WIDTH = 800;
+	const int HEIGHT = 640;
+
+	// screen space triangle of about size pixels across inside the viewport, with the
+	// attributes divided by w like the geometry stage leaves them
+	triangle random_triangle(bench_random &random, float size)
+	{
+		const float cx = random.uniform(size, WIDTH - size);
+		const float cy = random.uniform(size, HEIGHT - size);
+
+		triangle t;
+		for_range(i, 0, 3)
+		{
+			const float w = 1.0f / random.uniform(1.0f, 10.0f);
+			t.vs[i] = {cx + random.uniform(-size, size) * 0.5f, cy + random.uniform(-size, size) * 0.5f, 0.5f};
+			t.ts[i] = {random.uniform(0.0f, 1.0f) * w, random.uniform(0.0f, 1.0f) * w, w};
+		}
+		const uint8_t grey = (uint8_t)random.uniform(64.0f, 255.0f);
+		t.color = {grey, grey, grey, 255};
+		return t;
+	}
+
+	// pixel centers covered, about the area
+	uint64_t area(const std::vector<triangle> &ts)
+	{
+		double sum = 0.0;
+		for (auto &t : ts)
+		{
+			sum += fabs((t.vs[1].x - t.vs[0].x) * (t.vs[2].y - t.vs[0].y) - (t.vs[1].y - t.vs[0].y) * (t.vs[2].x - t.vs[0].x)) * 0.5;
+		}
+		return (uint64_t)sum;
+	}
+}
+
+void bench_raster(BenchRunner &runner)
+{
+	// xor pattern, every mip level differs
+	const int texture_size = 256;
+	std::vector<uint32_t> pixels(texture_size * texture_size);
+	for_range(y, 0, texture_size)
+	{
+		for_range(x, 0, texture_size) pixels[y * texture_size + x] = (uint32_t)((x ^ y) * 0x010101);
+	}
+	texture texture;
+	texture.load_from_pixels(pixels.data(), texture_size, texture_size, texture_size * sizeof(uint32_t));
+
+	// a single thread, the direct kernel calls run on the caller anyway
+	GlRender render(nullptr, 1, WIDTH, HEIGHT);
+	const rect viewport = render.viewport();
+
+	// the kernels alone, without hierarchical z
+	render.hiz = false;
+
+	const struct { const char *name; float size; int count; } sets[] = {
+		{"small", 12.0f, 8192},
+		{"large", 200.0f, 256},
+	};
+
+	for (auto &set : sets)
+	{
+		bench_random random;
+		std::vector<triangle> ts(set.count);
+		for (auto &t : ts) t = random_triangle(random, set.size);
+		const uint64_t covered = area(ts);
+
+		for (raster_mode mode : {raster_mode::scanline, raster_mode::halfspace})
+		{
+			const bool halfspace = mode == raster_mode::halfspace;
+			const std::string suffix = std::string(halfspace ? "_halfspace/" : "/") + set.name;
+
+			runner.run(("triangle_filled" + suffix).c_str(), ts.size(), [&]
+			{
+				for (auto &t : ts)
+				{
+					if (halfspace) render.triangle_filled_halfspace(t, viewport);
+					else render.triangle_filled(t, viewport);
+				}
+				return bench_work{ts.size(), covered};
+			});
+
+			// depth starts cleared every pass, pixels counts the ones that passed the depth test
+			runner.run(("triangle_textured" + suffix).c_str(), ts.size(), [&]
+			{
+				bench_work work{ts.size(), 0};
+				for (auto &t : ts)
+				{
+					if (halfspace) work.pixels += render.triangle_textured_halfspace(t, texture, 1.0f, viewport);
+					else work.pixels += render.triangle_textured(t, texture, 1.0f, viewport);
+				}
+				return work;
+			}, [&] { render.clear_depth(); });
+		}
+	}
+
+	// binning, lazy depth clear, hierarchical z and the kernels together
+	bench_random random;
+	std::vector<triangle> ts(4096);
+	for (auto &t : ts) t = random_triangle(random, 40.0f);
+
+	render.hiz = true;
+	for (raster_mode mode : {raster_mode::scanline, raster_mode::halfspace})
+	{
+		render.mode = mode;
+		runner.run(mode == raster_mode::halfspace ? "rasterize_textured_halfspace" : "rasterize_textured", ts.size(), [&]
+		{
+			render.rasterize(ts.data(), ts.size(), &texture, 1.0f);
+			return bench_work{ts.size(), render.pixels_shaded()};
+		}, [&] { render.start_frame(); });
+	}
+}
@@ -0,0 +1,273 @@
+#include <algorithm>
+
+#include "render.hpp"
+#include "texture.hpp"
+#include "triangle.hpp"
+#include "simd.hpp"
+
+// Half-space rasterization: every pixel center is tested against the three
+// edge functions of the triangle, 4 pixels of a row at a time.
+
+namespace
+{
+	// edge function of a -> b, positive on the inner side of a ccw triangle
+	struct edge {
+		float x0, y0;
+		float dx, dy;
+		bool top_left;
+
+		edge(const vec3 &a, const vec3 &b) : x0(a.x), y0(a.y), dx(-(b.y - a.y)), dy(b.x - a.x)
+		{
+			// y points down: left edges go up, top edges are horizontal going right
+			top_left = b.y < a.y || (b.y == a.y && b.x > a.x);
+		}
+
+		// evaluated relative to the edge origin to keep precision on large triangles
+		float at(float x, float y) const
+		{
+			return dy * (y - y0) + dx * (x - x0);
+		}
+
+		// top-left fill rule, pixels on a top or left edge are inside
+		f32x4 inside(f32x4 e) const
+		{
+			return top_left ? e >= f32x4::set1(0.0f) : e > f32x4::set1(0.0f);
+		}
+	};
+
+	struct setup {
+		int x_min, x_max;
+		int y_min, y_max;
+		float area;
+	};
+
+	// orders the triangle ccw and computes its scissored pixel bounds, false if nothing is covered
+	bool triangle_setup(triangle &t, const rect &clip, setup &s)
+	{
+		s.area = (t.vs[1].x - t.vs[0].x) * (t.vs[2].y - t.vs[0].y) - (t.vs[1].y - t.vs[0].y) * (t.vs[2].x - t.vs[0].x);
+		if (s.area == 0.0f) return false;
+
+		if (s.area < 0.0f)
+		{
+			std::swap(t.vs[1], t.vs[2]);
+			std::swap(t.ts[1], t.ts[2]);
+			s.area = -s.area;
+		}
+
+		const float x0 = std::min(t.vs[0].x, std::min(t.vs[1].x, t.vs[2].x));
+		const float x1 = std::max(t.vs[0].x, std::max(t.vs[1].x, t.vs[2].x));
+		const float y0 = std::min(t.vs[0].y, std::min(t.vs[1].y, t.vs[2].y));
+		const float y1 = std::max(t.vs[0].y, std::max(t.vs[1].y, t.vs[2].y));
+
+		s.x_min = std::max((int)ceilf(x0 - 0.5f), clip.x0);
+		s.x_max = std::min((int)floorf(x1 - 0.5f) + 1, clip.x1);
+		s.y_min = std::max((int)ceilf(y0 - 0.5f), clip.y0);
+		s.y_max = std::min((int)floorf(y1 - 0.5f) + 1, clip.y1);
+
+		return s.x_min < s.x_max && s.y_min < s.y_max;
+	}
+
+	const f32x4 lane_offset = f32x4::set(0.0f, 1.0f, 2.0f, 3.0f);
+}
+
+void GlRender::triangle_filled_halfspace(triangle t, rect clip)
+{
+	setup s;
+	if (!triangle_setup(t, clip, s)) return;
+
+	const uint32_t color = pack_color(t.color);
+	const edge es[3] = {{t.vs[1], t.vs[2]}, {t.vs[2], t.vs[0]}, {t.vs[0], t.vs[1]}};
+
+	f32x4 step[3];
+	for_range(k, 0, 3) step[k] = f32x4::set1(es[k].dx * 4.0f);
+
+	const f32x4 x_end = f32x4::set1((float)s.x_max);
+
+	for (int y = s.y_min; y < s.y_max; y++)
+	{
+		const float py = (float)y + 0.5f;
+		const float px = (float)s.x_min + 0.5f;
+
+		f32x4 e[3];
+		for_range(k, 0, 3) e[k] = f32x4::set1(es[k].at(px, py)) + lane_offset * f32x4::set1(es[k].dx);
+
+		uint32_t *row = &color_buffer[y * frame_width];
+		bool entered = false;
+
+		for (int x = s.x_min; x < s.x_max; x += 4)
+		{
+			const f32x4 in_row = f32x4::set1((float)x) + lane_offset < x_end;
+			const int mask = (es[0].inside(e[0]) & es[1].inside(e[1]) & es[2].inside(e[2]) & in_row).movemask();
+
+			for_range(k, 0, 3) e[k] = e[k] + step[k];
+
+			if (mask == 0)
+			{
+				// the triangle is convex, once left the row is done
+				if (entered) break;
+				continue;
+			}
+			entered = true;
+
+			if (mask == 0xf)
+			{
+				row[x] = row[x + 1] = row[x + 2] = row[x + 3] = color;
+				continue;
+			}
+
+			for_range(i, 0, 4)
+			{
+				if (mask & (1 << i)) row[x + i] = color;
+			}
+		}
+	}
+}
+
+int GlRender::triangle_textured_halfspace(triangle t, const texture &texture, float texture_scale, rect clip)
+{
+	setup s;
+	if (!triangle_setup(t, clip, s)) return 0;
+
+	const int level = triangle_lod(t, texture, texture_scale);
+
+	const edge es[3] = {{t.vs[1], t.vs[2]}, {t.vs[2], t.vs[0]}, {t.vs[0], t.vs[1]}};
+	const float inv_area = 1.0f / s.area;
+
+	// attribute a = a0 + (a1 - a0) * l1 + (a2 - a0) * l2, with l1 and l2 the
+	// barycentric weights from edges 1 and 2
+	auto gradient = [&](float a0, float a1, float a2, float &dx)
+	{
+		dx = ((a1 - a0) * es[1].dx + (a2 - a0) * es[2].dx) * inv_area;
+	};
+
+	auto value = [&](float a0, float a1, float a2, float px, float py)
+	{
+		return a0 + ((a1 - a0) * es[1].at(px, py) + (a2 - a0) * es[2].at(px, py)) * inv_area;
+	};
+
+	float du, dv, dw;
+	gradient(t.ts[0].u, t.ts[1].u, t.ts[2].u, du);
+	gradient(t.ts[0].v, t.ts[1].v, t.ts[2].v, dv);
+	gradient(t.ts[0].w, t.ts[1].w, t.ts[2].w, dw);
+
+	f32x4 step[3];
+	for_range(k, 0, 3) step[k] = f32x4::set1(es[k].dx * 4.0f);
+
+	const f32x4 u_step = f32x4::set1(du * 4.0f);
+	const f32x4 v_step = f32x4::set1(dv * 4.0f);
+	const f32x4 w_step = f32x4::set1(dw * 4.0f);
+
+	const f32x4 one = f32x4::set1(1.0f);
+	const f32x4 scale = f32x4::set1(texture_scale);
+	const f32x4 tex_w = f32x4::set1((float)texture.width(level));
+	const f32x4 tex_h = f32x4::set1((float)texture.height(level));
+
+	// nearest 1/w of the triangle inside a pixel rectangle, 1/w is affine so it is at a corner
+	const float nearest = std::max(t.ts[0].w, std::max(t.ts[1].w, t.ts[2].w));
+	auto rect_nearest = [&](int x0, int x1, int y0, int y1)
+	{
+		float w_max = 0.0f;
+		for (int y : {y0, y1 - 1})
+		{
+			for (int x : {x0, x1 - 1}) w_max = std::max(w_max, value(t.ts[0].w, t.ts[1].w, t.ts[2].w, (float)x + 0.5f, (float)y + 0.5f));
+		}
+		return std::min(w_max, nearest);
+	};
+
+	// pixels of the current block row that are not behind the hierarchical z,
+	// only worth it when the triangle spans several blocks
+	int row_x_min = s.x_min, row_x_max = s.x_max;
+	int shaded = 0;
+	const bool hiz_rows = hiz && s.x_max - s.x_min > 2 * HIZ_SIZE;
+
+	for (int y = s.y_min; y < s.y_max; y++)
+	{
+		if (hiz_rows && (y == s.y_min || y % HIZ_SIZE == 0))
+		{
+			const int by = y / HIZ_SIZE;
+			const int y0 = std::max(by * HIZ_SIZE, s.y_min);
+			const int y1 = std::min(by * HIZ_SIZE + HIZ_SIZE, s.y_max);
+
+			auto hidden = [&](int bx)
+			{
+				const int x0 = std::max(bx * HIZ_SIZE, s.x_min);
+				const int x1 = std::min(bx * HIZ_SIZE + HIZ_SIZE, s.x_max);
+				return hiz_block_hides(bx, by, rect_nearest(x0, x1, y0, y1));
+			};
+
+			int bx0 = s.x_min / HIZ_SIZE, bx1 = (s.x_max - 1) / HIZ_SIZE;
+			while (bx0 <= bx1 && hidden(bx0)) bx0++;
+			while (bx1 > bx0 && hidden(bx1)) bx1--;
+
+			row_x_min = std::max(bx0 * HIZ_SIZE, s.x_min);
+			row_x_max = std::min(bx1 * HIZ_SIZE + HIZ_SIZE, s.x_max);
+		}
+		if (row_x_min >= row_x_max) continue;
+
+		const float py = (float)y + 0.5f;
+		const float px = (float)row_x_min + 0.5f;
+		const f32x4 x_end = f32x4::set1((float)row_x_max);
+
+		f32x4 e[3];
+		for_range(k, 0, 3) e[k] = f32x4::set1(es[k].at(px, py)) + lane_offset * f32x4::set1(es[k].dx);
+
+		f32x4 u = f32x4::set1(value(t.ts[0].u, t.ts[1].u, t.ts[2].u, px, py)) + lane_offset * f32x4::set1(du);
+		f32x4 v = f32x4::set1(value(t.ts[0].v, t.ts[1].v, t.ts[2].v, px, py)) + lane_offset * f32x4::set1(dv);
+		f32x4 w = f32x4::set1(value(t.ts[0].w, t.ts[1].w, t.ts[2].w, px, py)) + lane_offset * f32x4::set1(dw);
+
+		uint32_t *color_row = &color_buffer[y * frame_width];
+		float *depth_row = &depth_buffer[y * frame_width];
+		bool entered = false;
+
+		for (int x = row_x_min; x < row_x_max; x += 4, u = u + u_step, v = v + v_step, w = w + w_step)
+		{
+			const f32x4 in_row = f32x4::set1((float)x) + lane_offset < x_end;
+			f32x4 covered = es[0].inside(e[0]) & es[1].inside(e[1]) & es[2].inside(e[2]) & in_row;
+
+			for_range(k, 0, 3) e[k] = e[k] + step[k];
+
+			if (covered.movemask() == 0)
+			{
+				if (entered) break;
+				continue;
+			}
+			entered = true;
+			PROFILE_COUNT(profile_counter::pixels_tested, __builtin_popcount(covered.movemask()));
+
+			// the last chunk of the row can't be loaded whole, past row_x_max lies the
+			// tile of another worker or the end of the buffer
+			f32x4 depth;
+			if (x + 4 <= row_x_max) depth = f32x4::load(&depth_row[x]);
+			else
+			{
+				float tmp[4] = {};
+				for (int i = 0; x + i < row_x_max; i++) tmp[i] = depth_row[x + i];
+				depth = f32x4::load(tmp);
+			}
+
+			const int mask = (covered & (w > depth)).movemask();
+			if (mask == 0) continue;
+			shaded += __builtin_popcount(mask);
+
+			const f32x4 t_x = u / w * scale;
+			const f32x4 t_y = one - v / w * scale;
+
+			// floored like texture::sample(), coordinates below 0 wrap to the last texel
+			int32_t tx[4], ty[4];
+			(t_x * tex_w).floor().to_int(tx);
+			(t_y * tex_h).floor().to_int(ty);
+
+			float ws[4];
+			w.store(ws);
+
+			for_range(i, 0, 4)
+			{
+				if (!(mask & (1 << i))) continue;
+
+				color_row[x + i] = texture.texel(tx[i], ty[i], level);
+				depth_row[x + i] = ws[i];
+			}
+		}
+	}
+	return shaded;
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "headless.hpp"
+#include "resolution.hpp"
+#include "arena.hpp"
+#include "pipeline.hpp"
+#include "profile.hpp"
+
+int run_headless(GlState &state, GlRender &render, const headless_options &options)
+{
+	using clock = std::chrono::steady_clock;
+
+	std::vector<double> frame_ms;
+	frame_ms.reserve(options.frames);
+
+	// the first frame of every pipeline slot sizes the streams and its frame arena, later ones
+	// should not allocate
+	const int warm_up_frames = FramePipeline::DEPTH;
+	size_t first_allocations = 0;
+	size_t steady_allocations = 0;
+
+	// depth tested pixels, covered is counted outside of the timed part
+	uint64_t shaded = 0;
+	uint64_t covered = 0;
+
+	ResolutionController resolution(options.target_ms);
+	double scale_sum = 0;
+	float scale_min = 1.0f;
+
+	FramePipeline pipeline(state, render, options.pipeline, options.threads);
+
+#ifdef GL3D_PROFILE
+	ProfileLog profile_log;
+	if (options.profile_log != nullptr && !profile_log.open(options.profile_log))
+	{
+		std::cerr << "Unable to write " << options.profile_log << std::endl;
+		return 1;
+	}
+	frame_profile profile_sum;
+#endif
+
+	const auto bench_start = clock::now();
+	if (options.frames > 0)
+	{
+		state.step(options.frame_delta);
+		pipeline.submit(resolution.scale());
+	}
+
+	for_range(frame, 0, options.frames)
+	{
+		const size_t allocations = heap_allocations();
+		const auto frame_start = clock::now();
+
+		// the next frame is projected while this one is rasterized, its scale lags a frame behind
+		if (frame + 1 < options.frames)
+		{
+			state.step(options.frame_delta);
+			pipeline.submit(resolution.scale());
+		}
+
+		pipeline.draw({18, 18, 18, 255});
+		pipeline.present();
+
+		const std::chrono::duration<double, std::milli> elapsed = clock::now() - frame_start;
+		frame_ms.push_back(elapsed.count());
+
+		shaded += render.pixels_shaded();
+		covered += render.pixels_covered();
+
+#ifdef GL3D_PROFILE
+		profile_log.write(pipeline.profile());
+		profile_sum.add(pipeline.profile());
+#endif
+
+		if (options.target_ms > 0.0f)
+		{
+			const float scale = (float)render.width() / render.output_width();
+			scale_sum += scale;
+			scale_min = std::min(scale_min, scale);
+			resolution.update(elapsed.count());
+		}
+
+		if (frame < warm_up_frames) first_allocations += heap_allocations() - allocations;
+		else steady_allocations += heap_allocations() - allocations;
+	}
+	const std::chrono::duration<double> total = clock::now() - bench_start;
+
+	if (options.dump_path != nullptr && !render.dump_ppm(options.dump_path))
+	{
+		std::cerr << "Unable to write " << options.dump_path << std::endl;
+		return 1;
+	}
+
+	if (frame_ms.empty()) return 0;
+
+	double sum = 0;
+	for (auto ms : frame_ms) sum += ms;
+
+	std::sort(frame_ms.begin(), frame_ms.end());
+	const size_t p99 = std::min(frame_ms.size() - 1, (size_t)(frame_ms.size() * 0.99));
+
+	std::cout << "frames: " << frame_ms.size() << std::endl;
+	std::cout << "fps: " << frame_ms.size() / total.count() << std::endl;
+	std::cout << "frame ms: min " << frame_ms.front() << ", avg " << sum / frame_ms.size() << ", p99 " << frame_ms[p99] << std::endl;
+	if (options.target_ms > 0.0f)
+	{
+		std::cout << "render scale: avg " << scale_sum / frame_ms.size() << ", min " << scale_min
+			<< ", last " << render.width() << "x" << render.height() << std::endl;
+	}
+	if (covered > 0)
+	{
+		// shaded pixels beyond the covered ones were overwritten, sorting and hierarchical z lower it
+		std::cout << "pixels per frame: covered " << covered / frame_ms.size() << ", shaded " << shaded / frame_ms.size()
+			<< ", overdraw " << (double)shaded / covered << std::endl;
+	}
+#ifdef GL3D_PROFILE
+	// stages of parallel jobs are summed over the threads
+	std::cout << "stage ms per frame:";
+	for_range(i, 0, frame_profile::STAGES)
+	{
+		std::cout << (i ? ", " : " ") << profile_name((profile_stage)i) << " " << profile_sum.ms((profile_stage)i) / frame_ms.size();
+	}
+	std::cout << std::endl << "counts per frame:";
+	for_range(i, 0, frame_profile::COUNTERS)
+	{
+		std::cout << (i ? ", " : " ") << profile_name((profile_counter)i) << " " << profile_sum.counts[i] / frame_ms.size();
+	}
+	std::cout << std::endl;
+#endif
+#ifndef NDEBUG
+	std::cout << "heap allocations: first " << std::min(options.frames, warm_up_frames) << " frames " << first_allocations
+		<< ", later frames " << steady_allocations << std::endl;
+#endif
+	return 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "state.hpp"
+#include "render.hpp"
+
+struct headless_options {
+	int frames = 300;
+	// fixed simulation step, frames are not paced
+	float frame_delta = 1000.0f / 60.0f;
+	const char *dump_path = nullptr;
+	// frame time budget of the dynamic resolution, 0 renders every frame at full resolution
+	float target_ms = 0.0f;
+	// project the next frame on a geometry thread while the current one is rasterized
+	bool pipeline = true;
+	// geometry threads, 0 for one per core
+	unsigned threads = 0;
+	// per frame stage times and counters, CSV or JSON by extension; needs GL3D_PROFILE
+	const char *profile_log = nullptr;
+};
+
+// Renders a fixed number of frames offscreen and reports frame time statistics
+int run_headless(GlState &state, GlRender &render, const headless_options &options);
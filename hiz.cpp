@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cfloat>
+
+#include "render.hpp"
+#include "simd.hpp"
+
+// Hierarchical z. Depth is 1/w with greater values nearer, a pixel passes when its
+// 1/w is greater than the stored one. A block whose smallest stored 1/w is not
+// smaller than the largest 1/w of a triangle can't have any pixel pass.
+
+namespace
+{
+	// ceilf and floorf are library calls without SSE4.1, the bounds are taken for every triangle
+	int ceil_int(float v)
+	{
+		const int i = (int)v;
+		return (float)i < v ? i + 1 : i;
+	}
+
+	int floor_int(float v)
+	{
+		const int i = (int)v;
+		return (float)i > v ? i - 1 : i;
+	}
+}
+
+void GlRender::hiz_refresh_block(int bx, int by)
+{
+	const int x0 = bx * HIZ_SIZE;
+	const int x1 = std::min(x0 + HIZ_SIZE, frame_width);
+	const int y0 = by * HIZ_SIZE;
+	const int y1 = std::min(y0 + HIZ_SIZE, frame_height);
+
+	float farthest = FLT_MAX;
+	if (x1 - x0 == HIZ_SIZE)
+	{
+		f32x4 m = f32x4::set1(FLT_MAX);
+		for (int y = y0; y < y1; y++)
+		{
+			const float *row = &depth_buffer[y * frame_width + x0];
+			m = f32x4::min(m, f32x4::min(f32x4::load(row), f32x4::load(row + 4)));
+		}
+
+		float lanes[4];
+		m.store(lanes);
+		farthest = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+	}
+	else
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = x0; x < x1; x++) farthest = std::min(farthest, depth_buffer[y * frame_width + x]);
+		}
+	}
+
+	hiz_blocks[by * hiz_x + bx] = farthest;
+	hiz_block_writes[by * hiz_x + bx] = 0;
+}
+
+bool GlRender::hiz_tile_hides(int tile, float depth)
+{
+	if (depth <= hiz_tiles[tile]) return true;
+	if (hiz_tile_writes[tile] < HIZ_TILE_REBUILD) return false;
+
+	// built from the block values as they are, refreshing every dirty block of
+	// the tile would cost more than it saves
+	const int bx0 = (tile % tiles_x) * (TILE_SIZE / HIZ_SIZE);
+	const int by0 = (tile / tiles_x) * (TILE_SIZE / HIZ_SIZE);
+	const int bx1 = std::min(bx0 + TILE_SIZE / HIZ_SIZE, hiz_x);
+	const int by1 = std::min(by0 + TILE_SIZE / HIZ_SIZE, hiz_y);
+
+	float farthest = FLT_MAX;
+	for (int by = by0; by < by1; by++)
+	{
+		for (int bx = bx0; bx < bx1; bx++) farthest = std::min(farthest, hiz_blocks[by * hiz_x + bx]);
+	}
+
+	hiz_tiles[tile] = farthest;
+	hiz_tile_writes[tile] = 0;
+	return depth <= farthest;
+}
+
+rect GlRender::triangle_bounds(const triangle &t, const rect &clip)
+{
+	const float x0 = std::min(t.vs[0].x, std::min(t.vs[1].x, t.vs[2].x));
+	const float x1 = std::max(t.vs[0].x, std::max(t.vs[1].x, t.vs[2].x));
+	const float y0 = std::min(t.vs[0].y, std::min(t.vs[1].y, t.vs[2].y));
+	const float y1 = std::max(t.vs[0].y, std::max(t.vs[1].y, t.vs[2].y));
+
+	// pixel centers inside the bounds, same as the rasterizers
+	rect bounds;
+	bounds.x0 = std::max(ceil_int(x0 - 0.5f), clip.x0);
+	bounds.x1 = std::min(floor_int(x1 - 0.5f) + 1, clip.x1);
+	bounds.y0 = std::max(ceil_int(y0 - 0.5f), clip.y0);
+	bounds.y1 = std::min(floor_int(y1 - 0.5f) + 1, clip.y1);
+	return bounds;
+}
+
+bool GlRender::triangle_hidden(const triangle &t, const rect &bounds, int tile)
+{
+	if (bounds.x0 >= bounds.x1 || bounds.y0 >= bounds.y1) return true;
+
+	// 1/w is affine in screen space, the nearest point is a vertex
+	const float nearest = std::max(t.ts[0].w, std::max(t.ts[1].w, t.ts[2].w));
+	if (hiz_tile_hides(tile, nearest)) return true;
+
+	for (int by = bounds.y0 / HIZ_SIZE; by <= (bounds.y1 - 1) / HIZ_SIZE; by++)
+	{
+		for (int bx = bounds.x0 / HIZ_SIZE; bx <= (bounds.x1 - 1) / HIZ_SIZE; bx++)
+		{
+			if (!hiz_block_hides(bx, by, nearest)) return false;
+		}
+	}
+	return true;
+}
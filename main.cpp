@@ -1,15 +1,175 @@
 #include <iostream>
+#include <sstream>
 #include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
 #include "state.hpp"
 #include "render.hpp"
+#include "headless.hpp"
+#include "resolution.hpp"
+#include "scheduler.hpp"
+#include "pipeline.hpp"
+#include "profile.hpp"
 #include "base.hpp"
 
+static void usage(const char *name)
+{
+	std::cerr << "Usage: " << name << " [options] <mesh.obj> [texture]" << std::endl;
+	std::cerr << "  --headless <frames>  render offscreen and report frame times" << std::endl;
+	std::cerr << "  --dump <file.ppm>    write the last headless frame" << std::endl;
+	std::cerr << "  --threads <n>        rasterizer and geometry threads, 0 for one per core" << std::endl;
+	std::cerr << "  --size <w>x<h>       output resolution, default " << DEFAULT_WIDTH << "x" << DEFAULT_HEIGHT << std::endl;
+	std::cerr << "  --target-ms <ms>     lower the render resolution to hold this frame time, 0 never does;" << std::endl;
+	std::cerr << "                       defaults to the 60 Hz frame, 0 when headless" << std::endl;
+	std::cerr << "  --pacing <mode>      capped (60 Hz, default), vsync or uncapped" << std::endl;
+	std::cerr << "  --raster <mode>      scanline or halfspace, r toggles while running" << std::endl;
+	std::cerr << "  --subdiv <n>         max pixels between perspective divides, 1 for every pixel" << std::endl;
+	std::cerr << "  --span-error <e>     max affine texture error in texels" << std::endl;
+	std::cerr << "  --no-mipmaps         always sample the full resolution texture" << std::endl;
+	std::cerr << "  --no-guard-band      clip every triangle to the viewport" << std::endl;
+	std::cerr << "  --sort               rasterize textured triangles front to back, with hierarchical z" << std::endl;
+	std::cerr << "  --no-hiz             with --sort, depth test every pixel, no hierarchical z rejection" << std::endl;
+	std::cerr << "  --no-pipeline        project and rasterize a frame back to back on one thread" << std::endl;
+	std::cerr << "  --profile-log <file>  stage times and counters of every frame, CSV or .json;" << std::endl;
+	std::cerr << "                       needs a GL3D_PROFILE build (make PROFILE=1), p toggles its overlay" << std::endl;
+	std::cerr << "  --no-mesh-cache      always parse the OBJ file, no <mesh.obj>.cache files" << std::endl;
+}
+
 int main(int argc, const char **argv)
 {
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0)
+	bool headless = false;
+	headless_options options;
+	unsigned threads = 0;
+	raster_mode mode = raster_mode::scanline;
+	int span_subdiv = 16;
+	float span_error = 0.5f;
+	bool mipmaps = true;
+	bool guard_band = true;
+	bool mesh_cache = true;
+	bool hiz = true;
+	bool sort = false;
+	bool pipelined = true;
+	int width = DEFAULT_WIDTH;
+	int height = DEFAULT_HEIGHT;
+	// negative picks the default of the mode
+	float target_ms = -1.0f;
+	frame_pacing pacing = frame_pacing::capped;
+
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (!strcmp(argv[arg], "--headless") && arg + 1 < argc)
+		{
+			headless = true;
+			if (sscanf(argv[++arg], "%d", &options.frames) != 1 || options.frames <= 0)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[arg], "--dump") && arg + 1 < argc)
+		{
+			options.dump_path = argv[++arg];
+		}
+		else if (!strcmp(argv[arg], "--threads") && arg + 1 < argc)
+		{
+			threads = atoi(argv[++arg]);
+		}
+		else if (!strcmp(argv[arg], "--size") && arg + 1 < argc)
+		{
+			if (sscanf(argv[++arg], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[arg], "--target-ms") && arg + 1 < argc)
+		{
+			target_ms = std::max(0.0f, (float)atof(argv[++arg]));
+		}
+		else if (!strcmp(argv[arg], "--subdiv") && arg + 1 < argc)
+		{
+			span_subdiv = std::max(1, atoi(argv[++arg]));
+		}
+		else if (!strcmp(argv[arg], "--span-error") && arg + 1 < argc)
+		{
+			span_error = std::max(0.0f, (float)atof(argv[++arg]));
+		}
+		else if (!strcmp(argv[arg], "--no-mipmaps"))
+		{
+			mipmaps = false;
+		}
+		else if (!strcmp(argv[arg], "--no-guard-band"))
+		{
+			guard_band = false;
+		}
+		else if (!strcmp(argv[arg], "--no-hiz"))
+		{
+			hiz = false;
+		}
+		else if (!strcmp(argv[arg], "--sort"))
+		{
+			sort = true;
+		}
+		else if (!strcmp(argv[arg], "--no-pipeline"))
+		{
+			pipelined = false;
+		}
+		else if (!strcmp(argv[arg], "--profile-log") && arg + 1 < argc)
+		{
+#ifndef GL3D_PROFILE
+			std::cerr << "--profile-log needs a build with GL3D_PROFILE defined" << std::endl;
+			return 1;
+#endif
+			options.profile_log = argv[++arg];
+		}
+		else if (!strcmp(argv[arg], "--no-mesh-cache"))
+		{
+			mesh_cache = false;
+		}
+		else if (!strcmp(argv[arg], "--pacing") && arg + 1 < argc)
+		{
+			arg++;
+			if (!strcmp(argv[arg], "capped")) pacing = frame_pacing::capped;
+			else if (!strcmp(argv[arg], "vsync")) pacing = frame_pacing::vsync;
+			else if (!strcmp(argv[arg], "uncapped")) pacing = frame_pacing::uncapped;
+			else
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[arg], "--raster") && arg + 1 < argc)
+		{
+			arg++;
+			if (!strcmp(argv[arg], "scanline")) mode = raster_mode::scanline;
+			else if (!strcmp(argv[arg], "halfspace")) mode = raster_mode::halfspace;
+			else
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (arg >= argc)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	// no video subsystem is needed offscreen
+	Uint32 sdl_flags = headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER;
+	if (SDL_Init(sdl_flags) != 0)
 	{
 		std::cerr << "Unable to initialize SDL2: " << SDL_GetError() << std::endl;
 		return 1;
@@ -22,57 +182,168 @@ int main(int argc, const char **argv)
 		return 1;
 	}
 
-	assert(argc >= 2);
-	bool with_texture = argc > 2;
+	const char *mesh_path = argv[arg];
+	const char *texture_path = arg + 1 < argc ? argv[arg + 1] : nullptr;
+	bool with_texture = texture_path != nullptr;
 
 	texture texture;
-	if (with_texture) assert(texture.load_from_file(argv[2]));
+	if (with_texture && !texture.load_from_file(texture_path)) return 1;
 
 	mesh mesh;
-	assert(mesh.load_from_file(argv[1], with_texture));
+	if (!mesh.load_from_file(mesh_path, with_texture, mesh_cache))
+	{
+		std::cerr << "Mesh " << mesh_path << " not loaded" << std::endl;
+		return 1;
+	}
+
+	if (headless)
+	{
+		GlRender render(nullptr, threads, width, height);
+		render.mode = mode;
+		render.span_subdiv = span_subdiv;
+		render.span_error = span_error;
+		render.mipmaps = mipmaps;
+		render.hiz = hiz && sort;
+		// scripted rotation so every frame sees a different view
+		GlState state(mesh, with_texture ? &texture : nullptr, 1.0f);
+		state.guard_band = guard_band;
+		state.sort = sort;
 
-	SDL_Window *window = SDL_CreateWindow("gl3d", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WIDTH, HEIGHT, 0);
-	SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+		options.target_ms = std::max(0.0f, target_ms);
+		options.pipeline = pipelined;
+		options.threads = threads;
+		int status = run_headless(state, render, options);
+
+		IMG_Quit();
+		SDL_Quit();
+		return status;
+	}
 
-	GlRender render(renderer);
-	GlState state(mesh, with_texture ? &texture : nullptr);
-	bool running = true;
+	// frames rendered below the output resolution are stretched with filtering
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 
-	const float freq = SDL_GetPerformanceFrequency();
-	const float frame_delta = 1000.0f / 60.0f;
+	SDL_Window *window = SDL_CreateWindow("gl3d", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, 0);
+	Uint32 renderer_flags = SDL_RENDERER_ACCELERATED;
+	if (pacing == frame_pacing::vsync) renderer_flags |= SDL_RENDERER_PRESENTVSYNC;
+	SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, renderer_flags);
 
-	Uint64 last_time = SDL_GetPerformanceCounter();
-	while (running)
+	// scoped so the frame texture is released before the renderer
 	{
-		Uint64 current_time = SDL_GetPerformanceCounter();
-		float delta = (current_time - last_time) / freq * 1000.0f;
+		GlRender render(renderer, threads, width, height);
+		render.mode = mode;
+		render.span_subdiv = span_subdiv;
+		render.span_error = span_error;
+		render.mipmaps = mipmaps;
+		render.hiz = hiz && sort;
+		GlState state(mesh, with_texture ? &texture : nullptr);
+		state.guard_band = guard_band;
+		state.sort = sort;
+		bool running = true;
 
-		SDL_Event event;
-		while (SDL_PollEvent(&event))
+		const float freq = SDL_GetPerformanceFrequency();
+		const float frame_delta = 1000.0f / 60.0f;
+
+		// rendering has to fit in the frame, presenting comes on top
+		if (target_ms < 0.0f) target_ms = frame_delta;
+		ResolutionController resolution(target_ms);
+
+		// the simulation always steps at 60 Hz, whatever the pacing
+		FrameScheduler scheduler(pacing, frame_delta, frame_delta);
+		FramePipeline pipeline(state, render, pipelined, threads);
+
+#ifdef GL3D_PROFILE
+		ProfileLog profile_log;
+		if (options.profile_log != nullptr && !profile_log.open(options.profile_log))
+		{
+			std::cerr << "Unable to write " << options.profile_log << std::endl;
+			running = false;
+		}
+		bool profile_overlay_on = true;
+		Uint32 title_ticks = 0;
+#endif
+
+		// nothing is rendered while the view does not change
+		bool redraw = true;
+		bool moving = false;
+
+		while (running)
 		{
-			switch (event.type)
+			SDL_Event event;
+			while (running && scheduler.wait_event(event, !redraw && !moving && pipeline.pending() == 0))
 			{
-				case SDL_QUIT:
-					running = false;
-					break;
+				switch (event.type)
+				{
+					case SDL_QUIT:
+						running = false;
+						break;
+
+					case SDL_KEYDOWN:
+						if (event.key.keysym.sym == 'r')
+						{
+							render.mode = render.mode == raster_mode::scanline ? raster_mode::halfspace : raster_mode::scanline;
+						}
+#ifdef GL3D_PROFILE
+						if (event.key.keysym.sym == 'p') profile_overlay_on = !profile_overlay_on;
+#endif
+						redraw = true;
+						break;
 
-				case SDL_KEYDOWN:
-					state.keypress(event.key, delta);
-					break;
+					case SDL_WINDOWEVENT:
+						redraw = true;
+						break;
 
-				default:
-					break;
+					default:
+						break;
+				}
 			}
-		}
+			if (!running) break;
 
-		if (delta > frame_delta)
-		{
-			render.start_frame();
-			render.clear({18, 18, 18, 255});
-			state.update(render, delta);
-			render.end_frame();
+			// held keys move the camera, the loop keeps stepping until they are released
+			const Uint8 *keys = SDL_GetKeyboardState(nullptr);
+			for (int steps = scheduler.steps(); steps > 0; steps--) state.step(scheduler.step_ms(), keys);
+			moving = state.animating(keys);
+
+			if (redraw || moving)
+			{
+				pipeline.submit(resolution.scale());
+				redraw = false;
+			}
+
+			// while the view keeps changing a frame stays in flight, so the next one is
+			// projected while this one is rasterized
+			if (pipeline.pending() > (moving && pipelined ? 1 : 0))
+			{
+				const Uint64 frame_start = SDL_GetPerformanceCounter();
+				pipeline.draw({18, 18, 18, 255});
+				const float render_ms = (SDL_GetPerformanceCounter() - frame_start) / freq * 1000.0f;
+
+#ifdef GL3D_PROFILE
+				// the overlay shows the last complete frame, this one is not presented yet
+				if (profile_overlay_on) profile_overlay(render, pipeline.profile(), frame_delta);
+#endif
+				pipeline.present();
+
+				if (target_ms > 0.0f) resolution.update(render_ms);
+
+#ifdef GL3D_PROFILE
+				const frame_profile &profile = pipeline.profile();
+				profile_log.write(profile);
+
+				// the overlay bars are not labeled, their times go to the title twice a second
+				if (SDL_GetTicks() - title_ticks > 500)
+				{
+					std::ostringstream title;
+					title.precision(2);
+					title << std::fixed << "gl3d -";
+					for_range(i, 0, frame_profile::STAGES) title << " " << profile_name((profile_stage)i) << " " << profile.ms((profile_stage)i);
+					title << " ms, overdraw " << profile.overdraw();
+					SDL_SetWindowTitle(window, title.str().c_str());
+					title_ticks = SDL_GetTicks();
+				}
+#endif
+			}
 
-			last_time = current_time;
+			scheduler.frame_done();
 		}
 	}
 
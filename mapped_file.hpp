@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Read only memory mapping of a whole file, unmapped on destruction
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// an empty file opens successfully with a null data pointer
+	bool open(const char *path)
+	{
+		close();
+
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		length = st.st_size;
+		if (length > 0)
+		{
+			void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p == MAP_FAILED)
+			{
+				::close(fd);
+				length = 0;
+				return false;
+			}
+
+			// read front to back
+			madvise(p, length, MADV_SEQUENTIAL);
+			ptr = (const char *)p;
+		}
+
+		::close(fd);
+		return true;
+	}
+
+	void close()
+	{
+		if (ptr != nullptr) munmap((void *)ptr, length);
+		ptr = nullptr;
+		length = 0;
+	}
+
+	const char *data() const
+	{
+		return ptr;
+	}
+
+	size_t size() const
+	{
+		return length;
+	}
+
+private:
+	const char *ptr = nullptr;
+	size_t length = 0;
+};
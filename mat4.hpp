@@ -1,9 +1,16 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
 #include "vec3.hpp"
+#include "stream.hpp"
+#include "simd.hpp"
 #include "base.hpp"
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
 struct mat4 {
 	float m[4][4] = {};
 
@@ -17,6 +24,56 @@ struct mat4 {
 		};
 	}
 
+	// Transforms the points (w = 1) of in[begin, end) into clip space, out must be as large
+	// as in. Batches of 8 (AVX) or 4 (SSE2) points are transformed per iteration.
+	void transform(const vec3_view &in, vec4_stream &out, size_t begin, size_t end) const
+	{
+		float *const dst[4] = {out.x.data(), out.y.data(), out.z.data(), out.w.data()};
+		const float *x = in.x, *y = in.y, *z = in.z;
+
+		size_t i = begin;
+#if defined(__AVX__)
+		__m256 r[4][4];
+		for_range(row, 0, 4)
+		{
+			for_range(col, 0, 4) r[row][col] = _mm256_set1_ps(m[row][col]);
+		}
+
+		for (; i + 8 <= end; i += 8)
+		{
+			const __m256 vx = _mm256_loadu_ps(x + i);
+			const __m256 vy = _mm256_loadu_ps(y + i);
+			const __m256 vz = _mm256_loadu_ps(z + i);
+
+			for_range(col, 0, 4)
+			{
+				const __m256 o = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, r[0][col]), _mm256_mul_ps(vy, r[1][col])),
+					_mm256_add_ps(_mm256_mul_ps(vz, r[2][col]), r[3][col]));
+				_mm256_storeu_ps(dst[col] + i, o);
+			}
+		}
+#endif
+		f32x4 c[4][4];
+		for_range(row, 0, 4)
+		{
+			for_range(col, 0, 4) c[row][col] = f32x4::set1(m[row][col]);
+		}
+
+		for (; i + 4 <= end; i += 4)
+		{
+			const f32x4 vx = f32x4::load(x + i);
+			const f32x4 vy = f32x4::load(y + i);
+			const f32x4 vz = f32x4::load(z + i);
+
+			for_range(col, 0, 4) (vx * c[0][col] + vy * c[1][col] + vz * c[2][col] + c[3][col]).store(dst[col] + i);
+		}
+
+		for (; i < end; i++)
+		{
+			for_range(col, 0, 4) dst[col][i] = x[i] * m[0][col] + y[i] * m[1][col] + z[i] * m[2][col] + m[3][col];
+		}
+	}
+
 	mat4 operator*(mat4 &m2)
 	{
 		mat4 mat;
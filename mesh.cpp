@@ -1,144 +1,359 @@
-#include <cctype>
-#include <fstream>
-#include <sstream>
-#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <string>
 
 #include "mesh.hpp"
-#include "triangle.hpp"
+#include "mapped_file.hpp"
+#include "pool.hpp"
+#include "base.hpp"
 
-bool mesh::load_from_file(const char *path, bool with_texture)
+namespace
 {
-	std::ifstream f(path);
-	if (!f.is_open()) return false;
+	// newline aligned part of the file and everything parsed from it
+	struct obj_chunk {
+		const char *begin, *end;
 
-	std::vector<vec3> verts;
-	std::vector<vec2> textures;
+		// x, y, z per position
+		std::vector<float> positions;
+		std::vector<vec2> textures;
+		// position, texture index pairs, three corners per triangle. OBJ indices
+		// are 1-based and global, they are stored 0-based. Negative (relative)
+		// indices are stored as i - RELATIVE with i the index relative to the start
+		// of the chunk, negative when it points into an earlier chunk.
+		std::vector<int64_t> corners;
 
-	while (!f.eof())
+		float texture_max = 1.0f;
+		bool ok = true;
+	};
+
+	const char *skip_space(const char *p, const char *end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+		return p;
+	}
+
+	bool parse_float(const char *&p, const char *end, float &value)
+	{
+		p = skip_space(p, end);
+		if (p < end && *p == '+') p++;
+
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc()) return false;
+
+		p = result.ptr;
+		return true;
+	}
+
+	// relative indices are below 0 once biased, absolute ones are not
+	const int64_t RELATIVE = (int64_t)1 << 32;
+
+	// 1-based or negative OBJ index -> stored corner index, count is the number
+	// of elements parsed so far in this chunk. Relative indices are resolved once
+	// the sizes of the earlier chunks are known.
+	bool parse_index(const char *&p, const char *end, size_t count, int64_t &index)
 	{
-		char buf[256];
-		f.getline(buf, 256);
+		int value;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc() || value == 0) return false;
 
-		std::stringstream s;
-		s << buf;
+		p = result.ptr;
+		if (value > 0) index = value - 1;
+		else index = (int64_t)count + value - RELATIVE;
+		return true;
+	}
 
-		char c;
-		if (buf[0] == 'v')
+	// index that is not used, like normals or texture coordinates of an untextured mesh
+	bool skip_index(const char *&p, const char *end)
+	{
+		int value;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc()) return false;
+
+		p = result.ptr;
+		return true;
+	}
+
+	// f v v v ... or f v/t v/t v/t ..., any /n or //n suffix is ignored and
+	// polygons are split into a fan
+	bool parse_face(const char *p, const char *end, bool with_texture, obj_chunk &chunk, std::vector<int64_t> &polygon)
+	{
+		polygon.clear();
+		for (p = skip_space(p, end); p < end; p = skip_space(p, end))
 		{
-			if (buf[1] == 't')
+			int64_t v, t = 0;
+			if (!parse_index(p, end, chunk.positions.size() / 3, v)) return false;
+
+			if (p < end && *p == '/')
 			{
-				assert(with_texture);
-				vec2 t;
-				s >> c >> c >> t.u >> t.v;
-				textures.push_back(t);
-				texture_max = std::max(texture_max, std::max(t.u, t.v));
+				p++;
+				if (p < end && *p != '/')
+				{
+					if (with_texture)
+					{
+						if (!parse_index(p, end, chunk.textures.size(), t)) return false;
+					}
+					else if (!skip_index(p, end)) return false;
+				}
+				else if (with_texture) return false;
+
+				if (p < end && *p == '/')
+				{
+					p++;
+					if (!skip_index(p, end)) return false;
+				}
 			}
-			else if (buf[1] != 'n')
+			else if (with_texture) return false;
+
+			if (p < end && *p != ' ' && *p != '\t' && *p != '\r') return false;
+
+			polygon.push_back(v);
+			polygon.push_back(t);
+		}
+
+		const int n = polygon.size() / 2;
+		if (n < 3) return false;
+
+		for_range(i, 1, n - 1)
+		{
+			for (int k : {0, i, i + 1})
 			{
-				vec3 v;
-				s >> c >> v.x >> v.y >> v.z;
-				verts.push_back(v);
+				chunk.corners.push_back(polygon[k * 2]);
+				chunk.corners.push_back(polygon[k * 2 + 1]);
 			}
 		}
-		else if (buf[0] == 'f')
+		return true;
+	}
+
+	void parse_chunk(obj_chunk &chunk, bool with_texture)
+	{
+		std::vector<int64_t> polygon;
+
+		const char *p = chunk.begin;
+		while (p < chunk.end && chunk.ok)
 		{
-			if (!with_texture)
+			const char *line_end = (const char *)memchr(p, '\n', chunk.end - p);
+			if (line_end == nullptr) line_end = chunk.end;
+
+			const char *s = skip_space(p, line_end);
+			if (line_end - s >= 2 && (s[1] == ' ' || s[1] == '\t'))
 			{
-				int face[3];
-				s >> c >> face[0] >> face[1] >> face[2];
-				ts.push_back({verts[face[0] - 1], verts[face[1] - 1], verts[face[2] - 1]});
+				if (s[0] == 'v')
+				{
+					float x, y, z;
+					s += 2;
+					chunk.ok = parse_float(s, line_end, x) && parse_float(s, line_end, y) && parse_float(s, line_end, z);
+					chunk.positions.insert(chunk.positions.end(), {x, y, z});
+				}
+				else if (s[0] == 'f')
+				{
+					chunk.ok = parse_face(s + 2, line_end, with_texture, chunk, polygon);
+				}
 			}
-			else
+			else if (with_texture && line_end - s >= 3 && s[0] == 'v' && s[1] == 't')
 			{
-				int face_v[3] = {};
-				int face_vn = 0;
+				vec2 t;
+				s += 2;
+				chunk.ok = parse_float(s, line_end, t.u) && parse_float(s, line_end, t.v);
+				chunk.textures.push_back(t);
+				chunk.texture_max = std::max(chunk.texture_max, std::max(t.u, t.v));
+			}
 
-				int face_t[3] = {};
-				int face_tn = 0;
+			p = line_end + 1;
+		}
+	}
 
-				// Currently ignored
-				int normal;
+	// corner index -> mesh wide index, base is the first element of the chunk,
+	// false when out of range
+	bool resolve(int64_t index, size_t base, size_t total, int &resolved)
+	{
+		if (index < 0) index += RELATIVE + (int64_t)base;
+		if (index < 0 || (size_t)index >= total) return false;
 
-				enum {
-					PARSE_START,
-					PARSE_V,
-					PARSE_T,
-					PARSE_N,
-				} state = PARSE_START;
+		resolved = (int)index;
+		return true;
+	}
+}
 
-				bool done = false;
-				while (!s.eof() && !done)
-				{
-					char c = s.get();
+bool mesh::load_obj(const char *path, bool with_texture)
+{
+	MappedFile file;
+	if (!file.open(path)) return false;
 
-					switch (state)
-					{
-						case PARSE_START:
-							assert(c == 'f');
-							c = s.get();
-							assert(c == ' ');
-							state = PARSE_V;
-							break;
-
-						case PARSE_V:
-							assert(std::isdigit(c));
-							s.seekg((int)s.tellg() - 1);
-							s >> face_v[face_vn++];
-
-							c = s.get();
-							assert(c == '/');
-							state = PARSE_T;
-							break;
-
-						case PARSE_T:
-							if (c == '/') state = PARSE_N;
-							else
-							{
-								assert(std::isdigit(c));
-								s.seekg((int)s.tellg() - 1);
-								s >> face_t[face_tn++];
-
-								if (face_tn == 3)
-								{
-									done = true;
-									break;
-								}
-
-								c = s.get();
-								assert(c == '/' || c == ' ');
-								state = c == ' ' ? PARSE_V : PARSE_N;
-							}
-							break;
-
-						case PARSE_N:
-							assert(std::isdigit(c));
-							s.seekg((int)s.tellg() - 1);
-							s >> normal;
-
-							if (face_vn == 3)
-							{
-								done = true;
-								break;
-							}
-
-							c = s.get();
-							assert(c == ' ');
-							state = PARSE_V;
-							break;
-
-						default:
-							assert(false && "Unreachable");
-					}
-				}
+	ThreadPool pool;
 
-				// NOTE: vertex/texture index should start from 1
-				assert(face_tn == 3 && face_tn == 3);
-				ts.push_back({
-					verts[face_v[0] - 1], verts[face_v[1] - 1], verts[face_v[2] - 1],
-					textures[face_t[0] - 1], textures[face_t[1] - 1], textures[face_t[2] - 1],
-				});
-			}
+	// a few chunks per thread to balance uneven line lengths
+	const size_t chunk_size = 1 << 20;
+	const size_t chunk_n = std::max((size_t)1, std::min(file.size() / chunk_size, (size_t)pool.size() * 8));
+
+	std::vector<obj_chunk> chunks(chunk_n);
+	const char *data = file.data();
+	const char *data_end = data + file.size();
+	for_range(i, 0, (int)chunk_n)
+	{
+		const char *begin = i == 0 ? data : chunks[i - 1].end;
+		const char *end = data_end;
+		if (i + 1 < (int)chunk_n)
+		{
+			// move the split point past the end of its line
+			end = std::max(begin, data + file.size() * (i + 1) / chunk_n);
+			end = (const char *)memchr(end, '\n', data_end - end);
+			end = end == nullptr ? data_end : end + 1;
 		}
+
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+	}
+
+	pool.run(chunk_n, [&](size_t i, unsigned)
+	{
+		parse_chunk(chunks[i], with_texture);
+	});
+
+	// chunk offsets into the merged arrays
+	std::vector<size_t> position_base(chunk_n + 1), texture_base(chunk_n + 1), corner_base(chunk_n + 1);
+	for_range(i, 0, (int)chunk_n)
+	{
+		if (!chunks[i].ok) return false;
+
+		position_base[i + 1] = position_base[i] + chunks[i].positions.size() / 3;
+		texture_base[i + 1] = texture_base[i] + chunks[i].textures.size();
+		corner_base[i + 1] = corner_base[i] + chunks[i].corners.size() / 2;
+		texture_max = std::max(texture_max, chunks[i].texture_max);
 	}
+
+	const size_t position_n = position_base[chunk_n];
+	const size_t texture_n = texture_base[chunk_n];
+	const size_t corner_n = corner_base[chunk_n];
+
+	// merge positions and resolve the corner indices, every chunk writes its own range
+	vec3_stream positions;
+	positions.resize(position_n);
+	std::vector<vec2> textures(texture_n);
+	std::vector<int> corners(corner_n * 2);
+	std::vector<char> resolved(chunk_n);
+
+	pool.run(chunk_n, [&](size_t i, unsigned)
+	{
+		auto &chunk = chunks[i];
+		for_range(n, 0, (int)(chunk.positions.size() / 3))
+		{
+			positions.x[position_base[i] + n] = chunk.positions[n * 3 + 0];
+			positions.y[position_base[i] + n] = chunk.positions[n * 3 + 1];
+			positions.z[position_base[i] + n] = chunk.positions[n * 3 + 2];
+		}
+		std::copy(chunk.textures.begin(), chunk.textures.end(), textures.begin() + texture_base[i]);
+
+		bool ok = true;
+		int *out = corners.data() + corner_base[i] * 2;
+		for (size_t n = 0; n < chunk.corners.size(); n += 2)
+		{
+			int v = 0, t = 0;
+			ok &= resolve(chunk.corners[n], position_base[i], position_n, v);
+			if (with_texture) ok &= resolve(chunk.corners[n + 1], texture_base[i], texture_n, t);
+
+			*out++ = v;
+			*out++ = t;
+		}
+		resolved[i] = ok;
+
+		// release the chunk early, large files hold a lot of memory here
+		std::vector<float>().swap(chunk.positions);
+		std::vector<vec2>().swap(chunk.textures);
+		std::vector<int64_t>().swap(chunk.corners);
+	});
+
+	for (auto ok : resolved)
+	{
+		if (!ok) return false;
+	}
+
+	index_storage.resize(corner_n);
+
+	// without texture every position is a vertex of its own
+	if (!with_texture)
+	{
+		vertex_storage = std::move(positions);
+		for_range(n, 0, (int)corner_n) index_storage[n] = corners[n * 2];
+		return true;
+	}
+
+	// a vertex is a unique (position, texture) pair, the vertices sharing a
+	// position are chained from first_vertex, in order of first use
+	const uint32_t none = UINT32_MAX;
+	std::vector<uint32_t> first_vertex(position_n, none);
+	std::vector<uint32_t> next_vertex;
+	std::vector<int> vertex_texture;
+
+	for_range(n, 0, (int)corner_n)
+	{
+		const int v = corners[n * 2], t = corners[n * 2 + 1];
+
+		uint32_t *link = &first_vertex[v];
+		while (*link != none && vertex_texture[*link] != t) link = &next_vertex[*link];
+
+		// link may point into next_vertex, it is not used once next_vertex grows
+		uint32_t vertex = *link;
+		if (vertex == none)
+		{
+			vertex = vertex_storage.size();
+			*link = vertex;
+			vertex_storage.push_back(positions[v]);
+			uv_storage.push_back(textures[t]);
+			next_vertex.push_back(none);
+			vertex_texture.push_back(t);
+		}
+		index_storage[n] = vertex;
+	}
+	return true;
+}
+
+bool mesh::load_from_file(const char *path, bool with_texture, bool use_cache)
+{
+	// textured meshes have their own vertices, they are cached separately
+	const std::string cache_path = std::string(path) + (with_texture ? ".tex.cache" : ".cache");
+	if (use_cache && load_cache(cache_path.c_str(), path, with_texture)) return true;
+
+	if (!load_obj(path, with_texture)) return false;
+	build_bvh();
+
+	vs = vertex_storage;
+	uvs = {uv_storage.data(), uv_storage.size()};
+	indices = {index_storage.data(), index_storage.size()};
+	clusters = {cluster_storage.data(), cluster_storage.size()};
+	nodes = {node_storage.data(), node_storage.size()};
+
+	// face normals for culling and lighting, computed once instead of every frame
+	normal_storage.resize(triangle_count());
+	for_range(n, 0, (int)triangle_count())
+	{
+		vec3 v[3];
+		for_range(i, 0, 3) v[i] = vs[indices[n * 3 + i]];
+
+		auto line1 = v[1] - v[0];
+		auto line2 = v[2] - v[0];
+		auto normal = line1.cross_product(line2);
+
+		const float length = normal.lenght();
+		normal_storage[n] = length > 0.0f ? normal / length : vec3{0, 0, 0};
+	}
+	normals = {normal_storage.data(), normal_storage.size()};
+
+	if (vs.size() > 0)
+	{
+		bounds_min = bounds_max = vs[0];
+		for_range(i, 1, (int)vs.size())
+		{
+			bounds_min.x = std::min(bounds_min.x, vs.x[i]);
+			bounds_min.y = std::min(bounds_min.y, vs.y[i]);
+			bounds_min.z = std::min(bounds_min.z, vs.z[i]);
+			bounds_max.x = std::max(bounds_max.x, vs.x[i]);
+			bounds_max.y = std::max(bounds_max.y, vs.y[i]);
+			bounds_max.z = std::max(bounds_max.z, vs.z[i]);
+		}
+	}
+
+	// not being able to write the cache only costs the next start
+	if (use_cache) write_cache(cache_path.c_str(), path);
 	return true;
 }
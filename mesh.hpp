@@ -1,12 +1,76 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 
-#include "triangle.hpp"
+#include "vec3.hpp"
+#include "vec2.hpp"
+#include "stream.hpp"
+#include "mapped_file.hpp"
 
+// Consecutive triangles and the vertices only they use
+struct mesh_cluster {
+	uint32_t triangle_begin, triangle_end;
+	uint32_t vertex_begin, vertex_end;
+};
+
+// Bounding volume hierarchy node in depth first order, the children of an
+// inner node are the next node and second, a leaf holds a single cluster
+struct bvh_node {
+	vec3 bounds_min, bounds_max;
+	// 0 for leaves
+	uint32_t second = 0;
+	uint32_t cluster = 0;
+};
+
+// Indexed triangle mesh. A vertex is a unique position and texture
+// coordinate pair, shared by all the triangles referencing it.
+// The arrays are views, either into storage filled by the OBJ parser or
+// straight into a memory mapped cache file.
 struct mesh {
-	std::vector<triangle> ts;
+	vec3_view vs;
+	// one per vertex, empty when loaded without texture
+	array_view<vec2> uvs;
+	// three per triangle
+	array_view<uint32_t> indices;
+	// unit normal per triangle, zero for degenerate triangles
+	array_view<vec3> normals;
+	// triangles are grouped into clusters of up to CLUSTER_TRIANGLES spatially close
+	// triangles, nodes[0] is the root of the hierarchy over them
+	static const uint32_t CLUSTER_TRIANGLES = 128;
+	// deepest hierarchy the culling walk handles
+	static const uint32_t BVH_DEPTH_MAX = 64;
+	array_view<mesh_cluster> clusters;
+	array_view<bvh_node> nodes;
 	float texture_max = 1.0f;
+	// axis aligned bounds of the positions
+	vec3 bounds_min = {}, bounds_max = {};
+
+	size_t triangle_count() const
+	{
+		return indices.size() / 3;
+	}
+
+	// Maps path + ".cache" (".tex.cache" with texture) when it is up to date, otherwise
+	// parses the OBJ file and (with use_cache) writes the cache for the next run
+	bool load_from_file(const char *path, bool with_texture = false, bool use_cache = true);
+
+	// Writes the binary cache, it is renamed into place so readers never see a partial file
+	bool write_cache(const char *cache_path, const char *source_path) const;
+
+private:
+	vec3_stream vertex_storage;
+	std::vector<vec2> uv_storage;
+	std::vector<uint32_t> index_storage;
+	std::vector<vec3> normal_storage;
+	std::vector<mesh_cluster> cluster_storage;
+	std::vector<bvh_node> node_storage;
+	MappedFile cache;
+
+	bool load_obj(const char *path, bool with_texture);
+
+	// reorders the triangles and vertices of the storage into clusters
+	void build_bvh();
 
-	bool load_from_file(const char *path, bool with_texture = false);
+	bool load_cache(const char *cache_path, const char *source_path, bool with_texture);
 };
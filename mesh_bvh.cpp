@@ -0,0 +1,152 @@
+#include <algorithm>
+
+#include "mesh.hpp"
+#include "base.hpp"
+
+namespace
+{
+	struct build_triangle {
+		vec3 bounds_min, bounds_max;
+		vec3 centroid;
+		uint32_t index;
+	};
+
+	void grow(vec3 &bounds_min, vec3 &bounds_max, const vec3 &a_min, const vec3 &a_max)
+	{
+		bounds_min = {std::min(bounds_min.x, a_min.x), std::min(bounds_min.y, a_min.y), std::min(bounds_min.z, a_min.z)};
+		bounds_max = {std::max(bounds_max.x, a_max.x), std::max(bounds_max.y, a_max.y), std::max(bounds_max.z, a_max.z)};
+	}
+
+	float axis(const vec3 &v, int a)
+	{
+		return a == 0 ? v.x : a == 1 ? v.y : v.z;
+	}
+
+	// Median split on the longest centroid axis until a node holds a single cluster,
+	// nodes are emitted depth first and leaves reference clusters in the same order
+	void build_node(build_triangle *ts, uint32_t count, std::vector<bvh_node> &nodes, std::vector<build_triangle *> &leaves)
+	{
+		const uint32_t node = nodes.size();
+		nodes.emplace_back();
+
+		if (count <= mesh::CLUSTER_TRIANGLES)
+		{
+			nodes[node].cluster = leaves.size() / 2;
+			leaves.push_back(ts);
+			leaves.push_back(ts + count);
+			return;
+		}
+
+		vec3 centroid_min = ts[0].centroid, centroid_max = ts[0].centroid;
+		for_range(i, 1, (int)count) grow(centroid_min, centroid_max, ts[i].centroid, ts[i].centroid);
+
+		int split = 0;
+		for_range(a, 1, 3)
+		{
+			if (axis(centroid_max, a) - axis(centroid_min, a) > axis(centroid_max, split) - axis(centroid_min, split)) split = a;
+		}
+
+		const uint32_t half = count / 2;
+		std::nth_element(ts, ts + half, ts + count, [split](const build_triangle &a, const build_triangle &b)
+		{
+			return axis(a.centroid, split) < axis(b.centroid, split);
+		});
+
+		build_node(ts, half, nodes, leaves);
+		nodes[node].second = nodes.size();
+		build_node(ts + half, count - half, nodes, leaves);
+	}
+}
+
+void mesh::build_bvh()
+{
+	const uint32_t tri_n = index_storage.size() / 3;
+	node_storage.clear();
+	cluster_storage.clear();
+	if (tri_n == 0) return;
+
+	std::vector<build_triangle> ts(tri_n);
+	for_range(n, 0, (int)tri_n)
+	{
+		auto &t = ts[n];
+		t.index = n;
+		t.bounds_min = t.bounds_max = vertex_storage[index_storage[n * 3]];
+		for_range(i, 1, 3)
+		{
+			const vec3 v = vertex_storage[index_storage[n * 3 + i]];
+			grow(t.bounds_min, t.bounds_max, v, v);
+		}
+		t.centroid = {(t.bounds_min.x + t.bounds_max.x) * 0.5f, (t.bounds_min.y + t.bounds_max.y) * 0.5f, (t.bounds_min.z + t.bounds_max.z) * 0.5f};
+	}
+
+	// begin, end pairs of the triangles in each leaf
+	std::vector<build_triangle *> leaves;
+	build_node(ts.data(), tri_n, node_storage, leaves);
+
+	// Rebuild the vertex and index arrays cluster by cluster. Every cluster gets
+	// its own copy of the vertices it uses, so the vertices of the visible clusters
+	// can be transformed without touching the rest of the mesh.
+	vec3_stream cluster_vs;
+	std::vector<vec2> cluster_uvs;
+	std::vector<uint32_t> cluster_indices;
+	cluster_indices.reserve(index_storage.size());
+
+	const uint32_t none = UINT32_MAX;
+	std::vector<uint32_t> owner(vertex_storage.size(), none);
+	std::vector<uint32_t> remap(vertex_storage.size());
+
+	for (size_t leaf = 0; leaf < leaves.size(); leaf += 2)
+	{
+		const uint32_t cluster = cluster_storage.size();
+
+		mesh_cluster c;
+		c.triangle_begin = cluster_indices.size() / 3;
+		c.vertex_begin = cluster_vs.size();
+
+		for (build_triangle *t = leaves[leaf]; t != leaves[leaf + 1]; t++)
+		{
+			for_range(i, 0, 3)
+			{
+				const uint32_t v = index_storage[t->index * 3 + i];
+				if (owner[v] != cluster)
+				{
+					owner[v] = cluster;
+					remap[v] = cluster_vs.size();
+					cluster_vs.push_back(vertex_storage[v]);
+					if (!uv_storage.empty()) cluster_uvs.push_back(uv_storage[v]);
+				}
+				cluster_indices.push_back(remap[v]);
+			}
+		}
+
+		c.triangle_end = cluster_indices.size() / 3;
+		c.vertex_end = cluster_vs.size();
+		cluster_storage.push_back(c);
+	}
+
+	vertex_storage = std::move(cluster_vs);
+	uv_storage = std::move(cluster_uvs);
+	index_storage = std::move(cluster_indices);
+
+	// leaves bound their cluster's vertices, inner nodes their children, children come after parents
+	for (int node = node_storage.size() - 1; node >= 0; node--)
+	{
+		auto &n = node_storage[node];
+		if (n.second == 0)
+		{
+			const auto &c = cluster_storage[n.cluster];
+			n.bounds_min = n.bounds_max = vertex_storage[c.vertex_begin];
+			for_range(v, (int)c.vertex_begin + 1, (int)c.vertex_end)
+			{
+				const vec3 p = vertex_storage[v];
+				grow(n.bounds_min, n.bounds_max, p, p);
+			}
+		}
+		else
+		{
+			n.bounds_min = node_storage[node + 1].bounds_min;
+			n.bounds_max = node_storage[node + 1].bounds_max;
+			grow(n.bounds_min, n.bounds_max, node_storage[n.second].bounds_min, node_storage[n.second].bounds_max);
+		}
+	}
+}
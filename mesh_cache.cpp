@@ -0,0 +1,249 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mesh.hpp"
+
+// Binary mesh cache, a header followed by the arrays in native layout, each
+// aligned to a cache line so they can be used in place from the mapping.
+// Bump CACHE_VERSION whenever the layout or the meaning of a field changes.
+namespace
+{
+	const char CACHE_MAGIC[8] = {'g', 'l', '3', 'd', 'm', 's', 'h', '\0'};
+	const uint32_t CACHE_VERSION = 4;
+	const uint64_t CACHE_ALIGN = 64;
+	// reads back in another order on a machine of the other endianness
+	const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+	struct cache_header {
+		char magic[8];
+		uint32_t version;
+		uint32_t with_texture;
+
+		// the arrays are only usable in place on a machine with the same layout
+		uint32_t byte_order;
+		uint16_t float_size, index_size;
+
+		// the OBJ file the cache was built from, any change invalidates it
+		uint64_t source_size;
+		int64_t source_mtime;
+
+		uint64_t vertex_n;
+		uint64_t index_n;
+		float texture_max;
+		float bounds_min[3], bounds_max[3];
+
+		// byte offsets from the start of the file
+		uint64_t x_offset, y_offset, z_offset;
+		uint64_t uv_offset;
+		uint64_t index_offset;
+		// one per triangle
+		uint64_t normal_offset;
+
+		uint64_t cluster_n;
+		uint64_t node_n;
+		uint64_t cluster_offset;
+		uint64_t node_offset;
+	};
+
+	static_assert(sizeof(vec2) == 3 * sizeof(float), "uvs are mapped as vec2");
+	static_assert(sizeof(vec3) == 4 * sizeof(float), "normals are mapped as vec3");
+	static_assert(sizeof(mesh_cluster) == 16 && sizeof(bvh_node) == 40, "clusters and nodes are mapped in place");
+
+	bool source_stamp(const char *path, uint64_t &size, int64_t &mtime)
+	{
+		struct stat st;
+		if (stat(path, &st) != 0) return false;
+
+		size = st.st_size;
+		mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+		return true;
+	}
+
+	uint64_t align_up(uint64_t offset)
+	{
+		return (offset + CACHE_ALIGN - 1) & ~(CACHE_ALIGN - 1);
+	}
+
+	// array of count elements at offset lies within the file and is aligned
+	bool in_file(uint64_t offset, uint64_t count, uint64_t element, uint64_t file_size)
+	{
+		return offset % CACHE_ALIGN == 0 && offset <= file_size && count <= (file_size - offset) / element;
+	}
+
+	// the subtree of node spans the nodes up to end, in the depth first order of the builder
+	bool valid_subtree(const array_view<bvh_node> &nodes, uint32_t node, uint64_t end, size_t cluster_n, uint32_t depth)
+	{
+		const bvh_node &n = nodes[node];
+		if (n.second == 0) return node + 1 == end && n.cluster < cluster_n;
+
+		return depth + 1 < mesh::BVH_DEPTH_MAX && n.second > node + 1 && n.second < end &&
+			valid_subtree(nodes, node + 1, n.second, cluster_n, depth + 1) &&
+			valid_subtree(nodes, n.second, end, cluster_n, depth + 1);
+	}
+
+	// every index and range the renderer follows stays inside of its array
+	bool valid_topology(const mesh &m)
+	{
+		const size_t vertex_n = m.vs.size();
+		for (uint32_t index : m.indices)
+		{
+			if (index >= vertex_n) return false;
+		}
+
+		for (auto &cluster : m.clusters)
+		{
+			if (cluster.triangle_begin > cluster.triangle_end || cluster.triangle_end > m.triangle_count() ||
+				cluster.vertex_begin > cluster.vertex_end || cluster.vertex_end > vertex_n) return false;
+
+			// only the vertices of a cluster are transformed for its triangles
+			for (uint32_t n = cluster.triangle_begin * 3; n < cluster.triangle_end * 3; n++)
+			{
+				if (m.indices[n] < cluster.vertex_begin || m.indices[n] >= cluster.vertex_end) return false;
+			}
+		}
+
+		return m.nodes.empty() || valid_subtree(m.nodes, 0, m.nodes.size(), m.clusters.size(), 0);
+	}
+}
+
+bool mesh::load_cache(const char *cache_path, const char *source_path, bool with_texture)
+{
+	uint64_t source_size;
+	int64_t source_mtime;
+	if (!source_stamp(source_path, source_size, source_mtime)) return false;
+
+	if (!cache.open(cache_path)) return false;
+
+	const uint64_t file_size = cache.size();
+	if (file_size < sizeof(cache_header))
+	{
+		cache.close();
+		return false;
+	}
+
+	cache_header header;
+	std::memcpy(&header, cache.data(), sizeof(header));
+
+	const uint64_t uv_n = header.with_texture ? header.vertex_n : 0;
+	const bool valid = std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+		header.version == CACHE_VERSION &&
+		header.byte_order == CACHE_BYTE_ORDER &&
+		header.float_size == sizeof(float) &&
+		header.index_size == sizeof(uint32_t) &&
+		header.with_texture == (uint32_t)with_texture &&
+		header.source_size == source_size &&
+		header.source_mtime == source_mtime &&
+		in_file(header.x_offset, header.vertex_n, sizeof(float), file_size) &&
+		in_file(header.y_offset, header.vertex_n, sizeof(float), file_size) &&
+		in_file(header.z_offset, header.vertex_n, sizeof(float), file_size) &&
+		in_file(header.uv_offset, uv_n, sizeof(vec2), file_size) &&
+		in_file(header.index_offset, header.index_n, sizeof(uint32_t), file_size) &&
+		in_file(header.normal_offset, header.index_n / 3, sizeof(vec3), file_size) &&
+		in_file(header.cluster_offset, header.cluster_n, sizeof(mesh_cluster), file_size) &&
+		in_file(header.node_offset, header.node_n, sizeof(bvh_node), file_size) &&
+		header.index_n % 3 == 0;
+
+	if (!valid)
+	{
+		cache.close();
+		return false;
+	}
+
+	const char *data = cache.data();
+	vs.x = (const float *)(data + header.x_offset);
+	vs.y = (const float *)(data + header.y_offset);
+	vs.z = (const float *)(data + header.z_offset);
+	vs.n = header.vertex_n;
+	uvs = {(const vec2 *)(data + header.uv_offset), uv_n};
+	indices = {(const uint32_t *)(data + header.index_offset), header.index_n};
+	normals = {(const vec3 *)(data + header.normal_offset), header.index_n / 3};
+	clusters = {(const mesh_cluster *)(data + header.cluster_offset), header.cluster_n};
+	nodes = {(const bvh_node *)(data + header.node_offset), header.node_n};
+
+	// a damaged cache is parsed again instead of rendered out of bounds
+	if (!valid_topology(*this))
+	{
+		vs = {};
+		uvs = {};
+		indices = {};
+		normals = {};
+		clusters = {};
+		nodes = {};
+		cache.close();
+		return false;
+	}
+
+	texture_max = header.texture_max;
+	bounds_min = {header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]};
+	bounds_max = {header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]};
+	return true;
+}
+
+bool mesh::write_cache(const char *cache_path, const char *source_path) const
+{
+	cache_header header = {};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.byte_order = CACHE_BYTE_ORDER;
+	header.float_size = sizeof(float);
+	header.index_size = sizeof(uint32_t);
+	header.with_texture = !uvs.empty();
+	if (!source_stamp(source_path, header.source_size, header.source_mtime)) return false;
+
+	header.vertex_n = vs.size();
+	header.index_n = indices.size();
+	header.cluster_n = clusters.size();
+	header.node_n = nodes.size();
+	header.texture_max = texture_max;
+	header.bounds_min[0] = bounds_min.x;
+	header.bounds_min[1] = bounds_min.y;
+	header.bounds_min[2] = bounds_min.z;
+	header.bounds_max[0] = bounds_max.x;
+	header.bounds_max[1] = bounds_max.y;
+	header.bounds_max[2] = bounds_max.z;
+
+	struct section { uint64_t *offset; const void *data; uint64_t size; };
+	const section sections[] = {
+		{&header.x_offset, vs.x, vs.size() * sizeof(float)},
+		{&header.y_offset, vs.y, vs.size() * sizeof(float)},
+		{&header.z_offset, vs.z, vs.size() * sizeof(float)},
+		{&header.uv_offset, uvs.data(), uvs.size() * sizeof(vec2)},
+		{&header.index_offset, indices.data(), indices.size() * sizeof(uint32_t)},
+		{&header.normal_offset, normals.data(), normals.size() * sizeof(vec3)},
+		{&header.cluster_offset, clusters.data(), clusters.size() * sizeof(mesh_cluster)},
+		{&header.node_offset, nodes.data(), nodes.size() * sizeof(bvh_node)},
+	};
+
+	uint64_t offset = align_up(sizeof(header));
+	for (auto &s : sections)
+	{
+		*s.offset = offset;
+		offset = align_up(offset + s.size);
+	}
+
+	// written next to the final file and renamed, concurrent readers see the old or the new cache
+	const std::string tmp_path = std::string(cache_path) + ".tmp" + std::to_string(getpid());
+	FILE *f = fopen(tmp_path.c_str(), "wb");
+	if (f == nullptr) return false;
+
+	const char zeros[CACHE_ALIGN] = {};
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	uint64_t written = sizeof(header);
+	for (auto &s : sections)
+	{
+		ok = ok && fwrite(zeros, 1, *s.offset - written, f) == *s.offset - written;
+		ok = ok && (s.size == 0 || fwrite(s.data, 1, s.size, f) == s.size);
+		written = *s.offset + s.size;
+	}
+
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(tmp_path.c_str(), cache_path) != 0)
+	{
+		remove(tmp_path.c_str());
+		return false;
+	}
+	return true;
+}
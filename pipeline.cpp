@@ -0,0 +1,114 @@
+#include <cassert>
+
+#include "pipeline.hpp"
+
+FramePipeline::FramePipeline(GlState &state, GlRender &render, bool threaded, unsigned threads)
+: state(state), render(render), geometry_pool(threads)
+{
+	if (threaded) geometry_thread = std::thread([this] { work(); });
+}
+
+FramePipeline::~FramePipeline()
+{
+	if (!geometry_thread.joinable()) return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	geometry_thread.join();
+}
+
+void FramePipeline::project(frame &f)
+{
+	f.arena.reset();
+#ifdef GL3D_PROFILE
+	f.geometry.profile.reset();
+#endif
+	state.project(f.view, f.arena, geometry_pool, f.geometry);
+	PROFILE_FLUSH(f.geometry.profile);
+}
+
+void FramePipeline::submit(float render_scale)
+{
+	assert(pending() < DEPTH && "FramePipeline: draw() before submitting more frames");
+
+	// the slot of the frame drawn DEPTH frames ago, nothing reads it anymore
+	frame &f = frames[submitted % DEPTH];
+	f.render_scale = render_scale;
+	f.view = state.view(render, render.viewport(render_scale));
+	submitted++;
+
+	if (!geometry_thread.joinable())
+	{
+		project(f);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queued = submitted;
+	}
+	wake.notify_one();
+}
+
+bool FramePipeline::draw(SDL_Color background)
+{
+	if (pending() == 0) return false;
+
+	if (geometry_thread.joinable())
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this] { return projected > drawn; });
+	}
+
+	frame &f = frames[drawn % DEPTH];
+	render.set_render_scale(f.render_scale);
+	render.start_frame();
+	render.clear(background);
+	state.rasterize(render, f.geometry);
+	drawn++;
+
+#ifdef GL3D_PROFILE
+	current_profile.reset();
+	current_profile.add(f.geometry.profile);
+	current_profile.add(render.profile);
+#endif
+	return true;
+}
+
+void FramePipeline::present()
+{
+	{
+		PROFILE_SCOPE(profile_stage::present);
+		render.end_frame();
+	}
+
+#ifdef GL3D_PROFILE
+	PROFILE_COUNT(profile_counter::pixels_covered, render.pixels_covered());
+	PROFILE_FLUSH(current_profile);
+	last_profile = current_profile;
+#endif
+}
+
+void FramePipeline::work()
+{
+	while (true)
+	{
+		uint64_t n;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || projected < queued; });
+			if (stopping) return;
+			n = projected;
+		}
+
+		// frames are projected in submission order, one at a time
+		project(frames[n % DEPTH]);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		projected = n + 1;
+		done.notify_one();
+	}
+}
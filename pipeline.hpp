@@ -0,0 +1,93 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "state.hpp"
+#include "render.hpp"
+#include "arena.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
+
+// Two stage frame pipeline: a geometry thread projects frame N + 1 while the calling
+// thread rasterizes and presents frame N, a frame costs the slower stage instead of
+// both. Each frame in flight projects into its own arena, so the triangle lists are
+// double buffered and handed to the raster stage without copying.
+class FramePipeline
+{
+public:
+	static const int DEPTH = 2;
+
+	// threaded = false projects in submit() on the calling thread, same frames without overlap.
+	// Projection runs on its own pool of threads workers, 0 for one per hardware core.
+	FramePipeline(GlState &state, GlRender &render, bool threaded = true, unsigned threads = 0);
+
+	~FramePipeline();
+
+	FramePipeline(const FramePipeline &) = delete;
+	FramePipeline &operator=(const FramePipeline &) = delete;
+
+	// Queues the projection of the current state at render_scale, the state may step
+	// right after. At most DEPTH frames can be pending.
+	void submit(float render_scale = 1.0f);
+
+	// Waits for the oldest pending frame and rasterizes it over background, at the
+	// resolution it was submitted with. False when nothing is pending.
+	bool draw(SDL_Color background);
+
+	// presents the frame drawn last through end_frame() of the renderer
+	void present();
+
+#ifdef GL3D_PROFILE
+	// stages and counters of the last presented frame
+	const frame_profile &profile() const
+	{
+		return last_profile;
+	}
+#endif
+
+	// submitted frames not drawn yet
+	int pending() const
+	{
+		return (int)(submitted - drawn);
+	}
+
+private:
+	struct frame {
+		frame_view view;
+		float render_scale;
+		FrameArena arena;
+		frame_geometry geometry;
+	};
+
+	GlState &state;
+	GlRender &render;
+	frame frames[DEPTH];
+	ThreadPool geometry_pool;
+
+	// frame n uses frames[n % DEPTH], only touched by the calling thread
+	uint64_t submitted = 0;
+	uint64_t drawn = 0;
+
+#ifdef GL3D_PROFILE
+	frame_profile current_profile;
+	frame_profile last_profile;
+#endif
+
+	std::thread geometry_thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	// guarded by mutex
+	uint64_t queued = 0;
+	uint64_t projected = 0;
+	bool stopping = false;
+
+	void project(frame &f);
+
+	void work();
+};
@@ -0,0 +1,77 @@
+#include <algorithm>
+
+#include "pool.hpp"
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned i = 1; i < threads; i++)
+	{
+		workers.emplace_back([this, i] { work(i); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto &worker : workers) worker.join();
+}
+
+void ThreadPool::run_job(size_t n, job_fn fn, void *ctx)
+{
+	if (n == 0) return;
+
+	if (workers.empty() || n == 1)
+	{
+		for (size_t i = 0; i < n; i++) fn(ctx, i, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = fn;
+		job_ctx = ctx;
+		job_n = n;
+		next = 0;
+		busy = workers.size();
+		generation++;
+	}
+	wake.notify_all();
+
+	drain(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this] { return busy == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::drain(unsigned worker)
+{
+	size_t i;
+	while ((i = next.fetch_add(1, std::memory_order_relaxed)) < job_n) job(job_ctx, i, worker);
+}
+
+void ThreadPool::work(unsigned worker)
+{
+	uint64_t seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+		}
+
+		drain(worker);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0) done.notify_one();
+	}
+}
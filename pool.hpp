@@ -0,0 +1,63 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+// Fixed set of worker threads executing index ranges in parallel
+class ThreadPool
+{
+public:
+	// threads = 0 uses one thread per hardware core, the calling thread counts as one
+	ThreadPool(unsigned threads = 0);
+
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	unsigned size() const
+	{
+		return workers.size() + 1;
+	}
+
+	// Calls job(i, worker) for every i in [0, n) and waits for completion,
+	// worker is in [0, size()) and identifies the executing thread
+	template<typename F>
+	void run(size_t n, F &&job)
+	{
+		using job_type = typename std::remove_reference<F>::type;
+		run_job(n, [](void *ctx, size_t i, unsigned worker)
+		{
+			(*(job_type *)ctx)(i, worker);
+		}, (void *)&job);
+	}
+
+private:
+	using job_fn = void (*)(void *ctx, size_t i, unsigned worker);
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	job_fn job = nullptr;
+	void *job_ctx = nullptr;
+	size_t job_n = 0;
+	std::atomic<size_t> next{0};
+
+	unsigned busy = 0;
+	uint64_t generation = 0;
+	bool stopping = false;
+
+	void run_job(size_t n, job_fn fn, void *ctx);
+
+	void drain(unsigned worker);
+
+	void work(unsigned worker);
+};
@@ -0,0 +1,93 @@
+#ifdef GL3D_PROFILE
+
+#include <cstring>
+#include <algorithm>
+
+#include "profile.hpp"
+#include "render.hpp"
+
+thread_local frame_profile profile_local;
+
+const char *profile_name(profile_stage stage)
+{
+	static const char *names[] = {"project", "cull", "transform", "clip", "sort", "bin", "raster", "present"};
+	static_assert(sizeof(names) / sizeof(names[0]) == frame_profile::STAGES, "a name for every stage");
+	return names[(int)stage];
+}
+
+const char *profile_name(profile_counter counter)
+{
+	static const char *names[] = {"triangles_in", "triangles_culled", "triangles_clipped", "triangles_emitted",
+		"pixels_tested", "pixels_written", "pixels_covered"};
+	static_assert(sizeof(names) / sizeof(names[0]) == frame_profile::COUNTERS, "a name for every counter");
+	return names[(int)counter];
+}
+
+ProfileLog::~ProfileLog()
+{
+	if (out.is_open() && json) out << (frames > 0 ? "\n]\n" : "[]\n");
+}
+
+bool ProfileLog::open(const char *path)
+{
+	const size_t length = strlen(path);
+	json = length >= 5 && !strcmp(path + length - 5, ".json");
+
+	out.open(path);
+	if (!out) return false;
+	if (json) return true;
+
+	out << "frame";
+	for_range(i, 0, frame_profile::STAGES) out << "," << profile_name((profile_stage)i) << "_ms";
+	for_range(i, 0, frame_profile::COUNTERS) out << "," << profile_name((profile_counter)i);
+	out << ",overdraw\n";
+	return true;
+}
+
+void ProfileLog::write(const frame_profile &profile)
+{
+	if (!out.is_open()) return;
+
+	if (json)
+	{
+		out << (frames == 0 ? "[\n" : ",\n") << "{\"frame\": " << frames;
+		for_range(i, 0, frame_profile::STAGES) out << ", \"" << profile_name((profile_stage)i) << "_ms\": " << profile.ms((profile_stage)i);
+		for_range(i, 0, frame_profile::COUNTERS) out << ", \"" << profile_name((profile_counter)i) << "\": " << profile.counts[i];
+		out << ", \"overdraw\": " << profile.overdraw() << "}";
+	}
+	else
+	{
+		out << frames;
+		for_range(i, 0, frame_profile::STAGES) out << "," << profile.ms((profile_stage)i);
+		for_range(i, 0, frame_profile::COUNTERS) out << "," << profile.counts[i];
+		out << "," << profile.overdraw() << "\n";
+	}
+	frames++;
+}
+
+void profile_overlay(GlRender &render, const frame_profile &profile, float budget_ms)
+{
+	static const SDL_Color colors[] = {
+		{255, 255, 255, 255}, {80, 160, 255, 255}, {80, 220, 120, 255}, {255, 200, 60, 255},
+		{200, 120, 255, 255}, {255, 140, 60, 255}, {255, 80, 80, 255}, {120, 220, 220, 255},
+	};
+	static_assert(sizeof(colors) / sizeof(colors[0]) == frame_profile::STAGES, "a color for every stage");
+
+	const int bar_height = 4;
+	const int full = render.width() / 2;
+
+	for_range(i, 0, frame_profile::STAGES)
+	{
+		const int length = std::min(full, (int)(profile.ms((profile_stage)i) / budget_ms * full));
+		const int y0 = 2 + i * (bar_height + 2);
+
+		// budget marker behind every bar
+		for_range(y, y0, y0 + bar_height) render.put_pixel(2 + full, y, {255, 255, 255, 255});
+		for_range(y, y0, y0 + bar_height)
+		{
+			for_range(x, 2, 2 + length) render.put_pixel(x, y, colors[i]);
+		}
+	}
+}
+
+#endif
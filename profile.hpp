@@ -0,0 +1,152 @@
+#pragma once
+
+// Per frame stage timers and pipeline counters. Everything is compiled out unless
+// GL3D_PROFILE is defined (make PROFILE=1), the macros then expand to nothing.
+//
+// Timers and counters accumulate in thread local storage so the hot loops never
+// touch shared memory, PROFILE_FLUSH() adds them to a frame_profile at the end of
+// a job. Stage times of parallel jobs are summed over the threads.
+
+#ifdef GL3D_PROFILE
+
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+
+#include "base.hpp"
+
+class GlRender;
+
+enum class profile_stage {
+	// the whole geometry stage, cull, transform, clip and sort are part of it
+	project,
+	cull,
+	transform,
+	// the clusters that need clipping, projected as a whole
+	clip,
+	sort,
+	bin,
+	raster,
+	present,
+	count,
+};
+
+enum class profile_counter {
+	triangles_in,
+	// outside of the frustum or facing away
+	triangles_culled,
+	// sent through the frustum clipper
+	triangles_clipped,
+	triangles_emitted,
+	// depth tested, only the textured path is
+	pixels_tested,
+	pixels_written,
+	// pixels holding a triangle at the end of the frame, written / covered is the overdraw
+	pixels_covered,
+	count,
+};
+
+const char *profile_name(profile_stage stage);
+const char *profile_name(profile_counter counter);
+
+struct frame_profile {
+	static const int STAGES = (int)profile_stage::count;
+	static const int COUNTERS = (int)profile_counter::count;
+
+	uint64_t ns[STAGES] = {};
+	uint64_t counts[COUNTERS] = {};
+
+	void reset()
+	{
+		*this = frame_profile();
+	}
+
+	// atomic, workers flush into the same profile
+	void add(const frame_profile &other)
+	{
+		for_range(i, 0, STAGES) if (other.ns[i]) __atomic_fetch_add(&ns[i], other.ns[i], __ATOMIC_RELAXED);
+		for_range(i, 0, COUNTERS) if (other.counts[i]) __atomic_fetch_add(&counts[i], other.counts[i], __ATOMIC_RELAXED);
+	}
+
+	double ms(profile_stage stage) const
+	{
+		return ns[(int)stage] / 1e6;
+	}
+
+	uint64_t count(profile_counter counter) const
+	{
+		return counts[(int)counter];
+	}
+
+	double overdraw() const
+	{
+		const uint64_t covered = count(profile_counter::pixels_covered);
+		return covered > 0 ? (double)count(profile_counter::pixels_written) / covered : 0.0;
+	}
+};
+
+// what the calling thread measured since its last flush
+extern thread_local frame_profile profile_local;
+
+inline void profile_flush(frame_profile &profile)
+{
+	profile.add(profile_local);
+	profile_local.reset();
+}
+
+class profile_timer
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	profile_timer(profile_stage stage) : stage(stage), start(clock::now())
+	{
+	}
+
+	~profile_timer()
+	{
+		profile_local.ns[(int)stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+	}
+
+	profile_timer(const profile_timer &) = delete;
+	profile_timer &operator=(const profile_timer &) = delete;
+
+private:
+	profile_stage stage;
+	clock::time_point start;
+};
+
+// One line per frame, CSV or a JSON array of objects when the path ends in .json
+class ProfileLog
+{
+public:
+	~ProfileLog();
+
+	bool open(const char *path);
+
+	void write(const frame_profile &profile);
+
+private:
+	std::ofstream out;
+	bool json = false;
+	uint64_t frames = 0;
+};
+
+// Bar per stage in the top left corner of the color buffer, the full width of
+// the bars is budget_ms
+void profile_overlay(GlRender &render, const frame_profile &profile, float budget_ms);
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_SCOPE(stage) profile_timer PROFILE_CONCAT(profile_scope_, __LINE__)(stage)
+#define PROFILE_COUNT(counter, n) (profile_local.counts[(int)(counter)] += (n))
+#define PROFILE_FLUSH(profile) profile_flush(profile)
+
+#else
+
+#define PROFILE_SCOPE(stage)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_FLUSH(profile)
+
+#endif
@@ -1,21 +1,276 @@
 #include <iostream>
+#include <fstream>
 #include <cassert>
+#include <algorithm>
 
 #include "render.hpp"
 #include "texture.hpp"
 #include "triangle.hpp"
 
+GlRender::GlRender(SDL_Renderer *renderer, unsigned threads, int width, int height)
+: renderer(renderer), max_width(width), max_height(height), pool(threads)
+{
+	const int max_tiles = ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+	const int max_blocks = ((width + HIZ_SIZE - 1) / HIZ_SIZE) * ((height + HIZ_SIZE - 1) / HIZ_SIZE);
+
+	color_buffer.resize(width * height);
+	depth_buffer.resize(width * height);
+	tile_depth_cleared.resize(max_tiles);
+	hiz_blocks.resize(max_blocks);
+	hiz_tiles.resize(max_tiles);
+	hiz_block_writes.resize(max_blocks);
+	hiz_tile_writes.resize(max_tiles);
+	tile_shaded.resize(max_tiles);
+	bin_start.resize(max_tiles + 1);
+
+	set_render_scale(1.0f);
+
+	// streaming texture the color buffer is uploaded to once per frame
+	if (renderer != nullptr) frame_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+}
+
+rect GlRender::viewport(float scale) const
+{
+	scale = clamp(scale, 1.0f, 1.0f / 16.0f);
+
+	rect r;
+	r.x1 = std::min(max_width, std::max(1, (int)lroundf(max_width * scale)));
+	r.y1 = std::min(max_height, std::max(1, (int)lroundf(max_height * scale)));
+	return r;
+}
+
+void GlRender::set_render_scale(float scale)
+{
+	const rect r = viewport(scale);
+	frame_width = r.x1;
+	frame_height = r.y1;
+
+	tiles_x = (frame_width + TILE_SIZE - 1) / TILE_SIZE;
+	tiles_y = (frame_height + TILE_SIZE - 1) / TILE_SIZE;
+	hiz_x = (frame_width + HIZ_SIZE - 1) / HIZ_SIZE;
+	hiz_y = (frame_height + HIZ_SIZE - 1) / HIZ_SIZE;
+}
+
+void GlRender::clear(SDL_Color color)
+{
+	std::fill_n(color_buffer.data(), frame_width * frame_height, pack_color(color));
+}
+
+// DDA line, pixels outside of the framebuffer are dropped
+void GlRender::line(vec3 a, vec3 b, SDL_Color color)
+{
+	const float dx = b.x - a.x;
+	const float dy = b.y - a.y;
+	const int steps = (int)ceilf(std::max(fabsf(dx), fabsf(dy)));
+
+	if (steps == 0)
+	{
+		put_pixel((int)a.x, (int)a.y, color);
+		return;
+	}
+
+	const float x_step = dx / (float)steps;
+	const float y_step = dy / (float)steps;
+
+	float x = a.x, y = a.y;
+	for_range(i, 0, steps + 1)
+	{
+		put_pixel((int)x, (int)y, color);
+		x += x_step;
+		y += y_step;
+	}
+}
+
 void GlRender::triangle_frame(triangle t)
 {
-	set_color(t.color);
+	line(t.vs[0], t.vs[1], t.color);
+	line(t.vs[0], t.vs[2], t.color);
+	line(t.vs[2], t.vs[1], t.color);
+}
+
+const uint32_t *GlRender::bin_triangles(const triangle *ts, size_t count, const uint32_t *order)
+{
+	PROFILE_SCOPE(profile_stage::bin);
+
+	// tile range of every triangle, empty when it is off screen
+	struct tile_range { int tx0, ty0, tx1, ty1; };
+	tile_range *ranges = arena.allocate<tile_range>(count);
+
+	const int tiles = tiles_x * tiles_y;
+	std::memset(bin_start.data(), 0, (tiles + 1) * sizeof(uint32_t));
+	for_range(n, 0, (int)count)
+	{
+		auto &t = ts[n];
+		auto &range = ranges[n];
+
+		const float x_min = std::min(t.vs[0].x, std::min(t.vs[1].x, t.vs[2].x));
+		const float x_max = std::max(t.vs[0].x, std::max(t.vs[1].x, t.vs[2].x));
+		const float y_min = std::min(t.vs[0].y, std::min(t.vs[1].y, t.vs[2].y));
+		const float y_max = std::max(t.vs[0].y, std::max(t.vs[1].y, t.vs[2].y));
+
+		if (x_max < 0.0f || y_max < 0.0f || x_min >= (float)frame_width || y_min >= (float)frame_height)
+		{
+			range = {0, 0, -1, -1};
+			continue;
+		}
+
+		range.tx0 = std::max((int)x_min, 0) / TILE_SIZE;
+		range.ty0 = std::max((int)y_min, 0) / TILE_SIZE;
+		range.tx1 = std::min((int)x_max, frame_width - 1) / TILE_SIZE;
+		range.ty1 = std::min((int)y_max, frame_height - 1) / TILE_SIZE;
+
+		for_range(ty, range.ty0, range.ty1 + 1)
+		{
+			for_range(tx, range.tx0, range.tx1 + 1) bin_start[ty * tiles_x + tx + 1]++;
+		}
+	}
+
+	// counts -> offsets, then fill every bin in drawing order
+	for_range(tile, 0, tiles) bin_start[tile + 1] += bin_start[tile];
+
+	uint32_t *bins = arena.allocate<uint32_t>(bin_start[tiles]);
+	uint32_t *bin_end = arena.allocate<uint32_t>(tiles);
+	std::memcpy(bin_end, bin_start.data(), tiles * sizeof(uint32_t));
+
+	for_range(i, 0, (int)count)
+	{
+		const uint32_t n = order != nullptr ? order[i] : i;
+		auto &range = ranges[n];
+		for_range(ty, range.ty0, range.ty1 + 1)
+		{
+			for_range(tx, range.tx0, range.tx1 + 1) bins[bin_end[ty * tiles_x + tx]++] = n;
+		}
+	}
+	return bins;
+}
+
+void GlRender::rasterize(const triangle *ts, size_t count, const texture *texture, float texture_scale, const uint32_t *order)
+{
+	const uint32_t *bins = bin_triangles(ts, count, order);
+
+	PROFILE_SCOPE(profile_stage::raster);
+	pool.run(tiles_x * tiles_y, [&](size_t tile, unsigned)
+	{
+		rect clip;
+		clip.x0 = (tile % tiles_x) * TILE_SIZE;
+		clip.y0 = (tile / tiles_x) * TILE_SIZE;
+		clip.x1 = std::min(clip.x0 + TILE_SIZE, frame_width);
+		clip.y1 = std::min(clip.y0 + TILE_SIZE, frame_height);
+
+		// the scanline rasterizer extrapolates 1/w past the vertices, only its long spans are tested
+		const bool hiz_test = texture != nullptr && hiz;
+
+		// only textured triangles are depth tested
+		if (texture != nullptr && bin_start[tile] != bin_start[tile + 1] && !tile_depth_cleared[tile])
+		{
+			clear_tile_depth(tile);
+			tile_depth_cleared[tile] = 1;
+		}
 
-	SDL_RenderDrawLineF(renderer, t.vs[0].x, t.vs[0].y, t.vs[1].x, t.vs[1].y);
-	SDL_RenderDrawLineF(renderer, t.vs[0].x, t.vs[0].y, t.vs[2].x, t.vs[2].y);
-	SDL_RenderDrawLineF(renderer, t.vs[2].x, t.vs[2].y, t.vs[1].x, t.vs[1].y);
+		for_range(i, (int)bin_start[tile], (int)bin_start[tile + 1])
+		{
+			const uint32_t n = bins[i];
+			rect bounds;
+			if (hiz_test)
+			{
+				bounds = triangle_bounds(ts[n], clip);
+				if (mode == raster_mode::halfspace && triangle_hidden(ts[n], bounds, tile)) continue;
+			}
+
+			if (mode == raster_mode::halfspace)
+			{
+				if (texture != nullptr) tile_shaded[tile] += triangle_textured_halfspace(ts[n], *texture, texture_scale, clip);
+				else triangle_filled_halfspace(ts[n], clip);
+			}
+			else
+			{
+				if (texture != nullptr) tile_shaded[tile] += triangle_textured(ts[n], *texture, texture_scale, clip);
+				else triangle_filled(ts[n], clip);
+			}
+
+			// one mark per triangle is cheaper than tracking the written pixels
+			if (hiz_test) hiz_mark(bounds, tile);
+		}
+
+		PROFILE_COUNT(profile_counter::pixels_written, tile_shaded[tile]);
+		PROFILE_FLUSH(profile);
+	});
 }
 
-void GlRender::triangle_textured(triangle t, const texture &texture, float texture_scale)
+void GlRender::clear_depth()
 {
+	for_range(tile, 0, tiles_x * tiles_y)
+	{
+		clear_tile_depth(tile);
+		tile_depth_cleared[tile] = 1;
+	}
+}
+
+void GlRender::clear_tile_depth(int tile)
+{
+	const int x0 = (tile % tiles_x) * TILE_SIZE;
+	const int y0 = (tile / tiles_x) * TILE_SIZE;
+	const int x1 = std::min(x0 + TILE_SIZE, frame_width);
+	const int y1 = std::min(y0 + TILE_SIZE, frame_height);
+
+	for_range(y, y0, y1) std::memset(&depth_buffer[y * frame_width + x0], 0, (x1 - x0) * sizeof(float));
+
+	for_range(by, y0 / HIZ_SIZE, (y1 + HIZ_SIZE - 1) / HIZ_SIZE)
+	{
+		for_range(bx, x0 / HIZ_SIZE, (x1 + HIZ_SIZE - 1) / HIZ_SIZE)
+		{
+			hiz_blocks[by * hiz_x + bx] = 0.0f;
+			hiz_block_writes[by * hiz_x + bx] = 0;
+		}
+	}
+	hiz_tiles[tile] = 0.0f;
+	hiz_tile_writes[tile] = 0;
+}
+
+size_t GlRender::pixels_covered() const
+{
+	size_t covered = 0;
+	for_range(tile, 0, tiles_x * tiles_y)
+	{
+		if (!tile_depth_cleared[tile]) continue;
+
+		const int x0 = (tile % tiles_x) * TILE_SIZE;
+		const int y0 = (tile / tiles_x) * TILE_SIZE;
+		const int x1 = std::min(x0 + TILE_SIZE, frame_width);
+		const int y1 = std::min(y0 + TILE_SIZE, frame_height);
+
+		for_range(y, y0, y1)
+		{
+			for_range(x, x0, x1) covered += depth_buffer[y * frame_width + x] > 0.0f;
+		}
+	}
+	return covered;
+}
+
+// mip level from the ratio between the texture and screen area of the triangle
+int GlRender::triangle_lod(const triangle &t, const texture &texture, float texture_scale) const
+{
+	if (!mipmaps || texture.levels() == 1) return 0;
+
+	float u[3], v[3];
+	for_range(i, 0, 3)
+	{
+		u[i] = t.ts[i].u / t.ts[i].w;
+		v[i] = t.ts[i].v / t.ts[i].w;
+	}
+
+	const float uv_area = fabsf((u[1] - u[0]) * (v[2] - v[0]) - (v[1] - v[0]) * (u[2] - u[0]));
+	const float texel_area = uv_area * texture_scale * texture_scale * (float)texture.width() * (float)texture.height();
+	const float screen_area = fabsf((t.vs[1].x - t.vs[0].x) * (t.vs[2].y - t.vs[0].y) - (t.vs[1].y - t.vs[0].y) * (t.vs[2].x - t.vs[0].x));
+
+	return texture.lod(texel_area, screen_area);
+}
+
+int GlRender::triangle_textured(triangle t, const texture &texture, float texture_scale, rect clip)
+{
+	int shaded = 0;
+	const int level = triangle_lod(t, texture, texture_scale);
+
 	if (t.vs[1].y < t.vs[0].y)
 	{
 		std::swap(t.vs[1], t.vs[0]);
@@ -64,11 +319,10 @@ void GlRender::triangle_textured(triangle t, const texture &texture, float textu
 	if (dy2) dv2_step = dv2 / fabs(dy2);
 	if (dy2) dw2_step = dw2 / fabs(dy2);
 
-	float t_u, t_v, t_w;
 	if (dy1)
 	{
-		const int y_min = (int)ceilf(t.vs[0].y - 0.5f);
-		const int y_max = (int)ceilf(t.vs[1].y - 0.5f);
+		const int y_min = std::max((int)ceilf(t.vs[0].y - 0.5f), clip.y0);
+		const int y_max = std::min((int)ceilf(t.vs[1].y - 0.5f), clip.y1);
 
 		for (int i = y_min; i < y_max; i++)
 		{
@@ -91,39 +345,7 @@ void GlRender::triangle_textured(triangle t, const texture &texture, float textu
 				std::swap(t_sw, t_ew);
 			}
 
-			t_u = t_su;
-			t_v = t_sv;
-			t_w = t_sw;
-
-			float tstep = 1.0f / ((float)(bx - ax));
-			float t = 0.0f;
-
-			const int x_min = (int)ceilf(ax - 0.5f);
-			const int x_max = (int)ceilf(bx - 0.5f);
-
-			for (int j = x_min; j < x_max; j++)
-			{
-				t_u = (1.0f - t) * t_su + t * t_eu;
-				t_v = (1.0f - t) * t_sv + t * t_ev;
-				t_w = (1.0f - t) * t_sw + t * t_ew;
-
-				if (t_w > depth_buffer[i * WIDTH + j])
-				{
-					float t_x = clamp(t_u / t_w * texture_scale, 1.0f, 0.0f);
-					float t_y = clamp(1.0f - (t_v / t_w * texture_scale), 1.0f, 0.0f);
-
-					int x = (int)ceilf(t_x * texture.width());
-					int y = (int)ceilf(t_y * texture.height());
-
-					uint8_t r, g, b;
-					texture.get_pixel(x, y, r, g, b);
-
-					set_color({r, g, b});
-					SDL_RenderDrawPoint(renderer, j, i);
-					depth_buffer[i * WIDTH + j] = t_w;
-				}
-				t += tstep;
-			}
+			shaded += span_textured(i, ax, bx, {t_su, t_sv, t_sw}, {t_eu, t_ev, t_ew}, texture, level, texture_scale, clip);
 		}
 	}
 
@@ -144,8 +366,8 @@ void GlRender::triangle_textured(triangle t, const texture &texture, float textu
 
 	if (dy1)
 	{
-		const int y_min = (int)ceilf(t.vs[1].y - 0.5f);
-		const int y_max = (int)ceilf(t.vs[2].y - 0.5f);
+		const int y_min = std::max((int)ceilf(t.vs[1].y - 0.5f), clip.y0);
+		const int y_max = std::min((int)ceilf(t.vs[2].y - 0.5f), clip.y1);
 
 		for (int i = y_min; i < y_max; i++)
 		{
@@ -168,47 +390,149 @@ void GlRender::triangle_textured(triangle t, const texture &texture, float textu
 				std::swap(t_sw, t_ew);
 			}
 
-			t_u = t_su;
-			t_v = t_sv;
-			t_w = t_sw;
+			shaded += span_textured(i, ax, bx, {t_su, t_sv, t_sw}, {t_eu, t_ev, t_ew}, texture, level, texture_scale, clip);
+		}
+	}
+	return shaded;
+}
 
-			float tstep = 1.0f / ((float)(bx - ax));
-			float t = 0.0f;
+// Perspective correct texture span. u/w, v/w and 1/w are stepped incrementally
+// and u, v are only divided out at the ends of affine segments. The segment
+// length is picked per span so that the affine error stays below span_error
+// texels, and it is never longer than span_subdiv pixels.
+int GlRender::span_textured(int y, float ax, float bx, vec2 s, vec2 e, const texture &texture, int level, float texture_scale, const rect &clip)
+{
+	const int x_start = (int)ceilf(ax - 0.5f);
+	const int x_min = std::max(x_start, clip.x0);
+	const int x_max = std::min((int)ceilf(bx - 0.5f), clip.x1);
+	if (x_min >= x_max) return 0;
+
+	const float tstep = 1.0f / (bx - ax);
+	const float du = (e.u - s.u) * tstep;
+	const float dv = (e.v - s.v) * tstep;
+	const float dw = (e.w - s.w) * tstep;
+
+	const float offset = (float)(x_min - x_start);
+	float t_u = s.u + offset * du;
+	float t_v = s.v + offset * dv;
+	float t_w = s.w + offset * dw;
+
+	const float tex_w = (float)texture.width(level);
+	const float tex_h = (float)texture.height(level);
+
+	int segment = 1;
+	if (span_subdiv > 1)
+	{
+		// affine error over n pixels is about n^2 * |texel gradient| * |dw / w| / 4
+		const float len = (float)(x_max - x_min);
+		const float w_end = t_w + len * dw;
+		const float u0 = t_u / t_w, u1 = (t_u + len * du) / w_end;
+		const float v0 = t_v / t_w, v1 = (t_v + len * dv) / w_end;
+
+		const float gradient = std::max(fabsf(u1 - u0) * tex_w, fabsf(v1 - v0) * tex_h) * texture_scale / len;
+		const float w_change = fabsf(dw) / std::min(t_w, w_end);
+
+		const float error = gradient * w_change;
+		const float n = error > 0.0f ? sqrtf(4.0f * span_error / error) : (float)span_subdiv;
+		segment = clamp((int)std::min(n, (float)span_subdiv), span_subdiv, 1);
+	}
 
-			const int x_min = (int)ceilf(ax - 0.5f);
-			const int x_max = (int)ceilf(bx - 0.5f);
+	float *depth_row = &depth_buffer[y * frame_width];
+	uint32_t *color_row = &color_buffer[y * frame_width];
 
-			for (int j = x_min; j < x_max; j++)
-			{
-				t_u = (1.0f - t) * t_su + t * t_eu;
-				t_v = (1.0f - t) * t_sv + t * t_ev;
-				t_w = (1.0f - t) * t_sw + t * t_ew;
+	// 1/w is linear along the span, so the nearest pixel of a block is one of its ends,
+	// with a margin for the drift of the stepped 1/w
+	auto block_hidden = [&](int x, int block_end)
+	{
+		const float w0 = s.w + (float)(x - x_start) * dw;
+		const float w1 = s.w + (float)(block_end - 1 - x_start) * dw;
+		return hiz_block_hides(x / HIZ_SIZE, y / HIZ_SIZE, std::max(w0, w1) * 1.001f);
+	};
 
-				if (t_w > depth_buffer[i * WIDTH + j])
-				{
-					float t_x = clamp(t_u / t_w * texture_scale, 1.0f, 0.0f);
-					float t_y = clamp(1.0f - (t_v / t_w * texture_scale), 1.0f, 0.0f);
+	int shaded = 0;
 
-					int x = (int)ceilf(t_x * texture.width());
-					int y = (int)ceilf(t_y * texture.height());
+	// draws [x, end) in affine segments with exact values at the segment ends
+	auto draw = [&](int x, int end)
+	{
+		const float offset = (float)(x - x_start);
+		float t_u = s.u + offset * du;
+		float t_v = s.v + offset * dv;
+		float t_w = s.w + offset * dw;
+
+		float u = t_u / t_w;
+		float v = t_v / t_w;
+
+		PROFILE_COUNT(profile_counter::pixels_tested, end - x);
+		while (x < end)
+		{
+			const int n = std::min(segment, end - x);
+
+			const float seg_u = t_u + (float)n * du;
+			const float seg_v = t_v + (float)n * dv;
+			const float seg_w = t_w + (float)n * dw;
+			const float u_end = seg_u / seg_w;
+			const float v_end = seg_v / seg_w;
 
-					uint8_t r, g, b;
-					texture.get_pixel(x, y, r, g, b);
+			const float u_step = (u_end - u) / (float)n;
+			const float v_step = (v_end - v) / (float)n;
 
-					set_color({r, g, b});
-					SDL_RenderDrawPoint(renderer, j, i);
-					depth_buffer[i * WIDTH + j] = t_w;
+			for (const int seg_end = x + n; x < seg_end; x++)
+			{
+				if (t_w > depth_row[x])
+				{
+					color_row[x] = texture.sample(u * texture_scale, 1.0f - v * texture_scale, level);
+					depth_row[x] = t_w;
+					shaded++;
 				}
-				t += tstep;
+
+				u += u_step;
+				v += v_step;
+				t_w += dw;
 			}
+
+			// resync with the exact values to avoid drift
+			t_u = seg_u;
+			t_v = seg_v;
+			t_w = seg_w;
+			u = u_end;
+			v = v_end;
 		}
+	};
+
+	auto next_block = [&](int x)
+	{
+		return std::min((x / HIZ_SIZE + 1) * HIZ_SIZE, x_max);
+	};
+
+	// testing only pays off when the span crosses several blocks
+	const bool hiz_span = hiz && x_max - x_min > 2 * HIZ_SIZE;
+
+	for (int x = x_min; x < x_max;)
+	{
+		// skip the hidden blocks, then draw up to the next hidden one
+		if (hiz_span)
+		{
+			while (x < x_max && block_hidden(x, next_block(x))) x = next_block(x);
+			if (x == x_max) break;
+		}
+
+		int run_end = x_max;
+		if (hiz_span)
+		{
+			run_end = next_block(x);
+			while (run_end < x_max && !block_hidden(run_end, next_block(run_end))) run_end = next_block(run_end);
+		}
+
+		draw(x, run_end);
+		x = run_end;
 	}
+	return shaded;
 }
 
 // triangle scanline rasterization with top-left rule
-void GlRender::triangle_filled(triangle t)
+void GlRender::triangle_filled(triangle t, rect clip)
 {
-	set_color(t.color);
+	const uint32_t color = pack_color(t.color);
 
 	if (t.vs[1].y < t.vs[0].y) std::swap(t.vs[1], t.vs[0]);
 	if (t.vs[2].y < t.vs[0].y) std::swap(t.vs[2], t.vs[0]);
@@ -217,12 +541,12 @@ void GlRender::triangle_filled(triangle t)
 	if (t.vs[1].y == t.vs[2].y)
 	{
 		if (t.vs[2].x < t.vs[1].x) std::swap(t.vs[2], t.vs[1]);
-		triangle_bottom_flat(t);
+		triangle_bottom_flat(t, color, clip);
 	}
 	else if (t.vs[0].y == t.vs[1].y)
 	{
 		if (t.vs[1].x < t.vs[0].x) std::swap(t.vs[0], t.vs[1]);
-		triangle_top_flat(t);
+		triangle_top_flat(t, color, clip);
 	}
 	else
 	{
@@ -259,48 +583,62 @@ void GlRender::triangle_filled(triangle t)
 			tmp2.vs[2] = t.vs[2];
 		}
 
-		triangle_bottom_flat(tmp1);
-		triangle_top_flat(tmp2);
+		triangle_bottom_flat(tmp1, color, clip);
+		triangle_top_flat(tmp2, color, clip);
 	}
-	batch_flush();
 }
 
-void GlRender::triangle_bottom_flat(triangle t)
+void GlRender::triangle_bottom_flat(triangle t, uint32_t color, rect clip)
 {
 	float slope0 = (t.vs[1].x - t.vs[0].x) / (t.vs[1].y - t.vs[0].y);
 	float slope1 = (t.vs[2].x - t.vs[0].x) / (t.vs[2].y - t.vs[0].y);
 
-	const int y_min = (int)ceilf(t.vs[0].y - 0.5f);
-	const int y_max = (int)ceilf(t.vs[2].y - 0.5f);
+	const int y_min = std::max((int)ceilf(t.vs[0].y - 0.5f), clip.y0);
+	const int y_max = std::min((int)ceilf(t.vs[2].y - 0.5f), clip.y1);
 
 	for (int y = y_min; y < y_max; y++)
 	{
 		const float px0 = slope0 * ((float)y + 0.5f - t.vs[0].y) + t.vs[0].x;
 		const float px1 = slope1 * ((float)y + 0.5f - t.vs[0].y) + t.vs[0].x;
 
-		const int x_min = (int)ceilf(px0 - 0.5f);
-		const int x_max = (int)ceilf(px1 - 0.5f);
+		const int x_min = std::max((int)ceilf(px0 - 0.5f), clip.x0);
+		const int x_max = std::min((int)ceilf(px1 - 0.5f), clip.x1);
 
-		for (int x = x_min; x < x_max; x++) batch_add(x, y);
+		span_fill(y, x_min, x_max, color);
 	}
 }
 
-void GlRender::triangle_top_flat(triangle t)
+void GlRender::triangle_top_flat(triangle t, uint32_t color, rect clip)
 {
 	float slope0 = (t.vs[2].x - t.vs[0].x) / (t.vs[2].y - t.vs[0].y);
 	float slope1 = (t.vs[2].x - t.vs[1].x) / (t.vs[2].y - t.vs[1].y);
 
-	const int y_min = (int)ceilf(t.vs[0].y - 0.5f);
-	const int y_max = (int)ceilf(t.vs[2].y - 0.5f);
+	const int y_min = std::max((int)ceilf(t.vs[0].y - 0.5f), clip.y0);
+	const int y_max = std::min((int)ceilf(t.vs[2].y - 0.5f), clip.y1);
 
 	for (int y = y_min; y < y_max; y++)
 	{
 		const float px0 = slope0 * ((float)y + 0.5f - t.vs[0].y) + t.vs[0].x;
 		const float px1 = slope1 * ((float)y + 0.5f - t.vs[1].y) + t.vs[1].x;
 
-		const int x_min = (int)ceilf(px0 - 0.5f);
-		const int x_max = (int)ceilf(px1 - 0.5f);
+		const int x_min = std::max((int)ceilf(px0 - 0.5f), clip.x0);
+		const int x_max = std::min((int)ceilf(px1 - 0.5f), clip.x1);
+
+		span_fill(y, x_min, x_max, color);
+	}
+}
+
+bool GlRender::dump_ppm(const char *path) const
+{
+	std::ofstream f(path, std::ios::binary);
+	if (!f.is_open()) return false;
 
-		for (int x = x_min; x < x_max; x++) batch_add(x, y);
+	f << "P6\n" << frame_width << " " << frame_height << "\n255\n";
+	for_range(i, 0, frame_width * frame_height)
+	{
+		const uint32_t pixel = color_buffer[i];
+		const char rgb[3] = {(char)(pixel >> 16), (char)(pixel >> 8), (char)pixel};
+		f.write(rgb, 3);
 	}
+	return f.good();
 }
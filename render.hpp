@@ -2,74 +2,266 @@
 
 #include <SDL2/SDL.h>
 #include <cstring>
+#include <cstdint>
 #include <vector>
-#include <array>
 
 #include "base.hpp"
 #include "triangle.hpp"
 #include "texture.hpp"
 #include "vec3.hpp"
+#include "pool.hpp"
+#include "arena.hpp"
+#include "aligned_array.hpp"
+#include "profile.hpp"
+
+// half-open pixel rectangle used as scissor
+struct rect {
+	int x0 = 0, y0 = 0;
+	int x1 = 0, y1 = 0;
+};
+
+enum class raster_mode {
+	scanline,
+	halfspace,
+};
 
 class GlRender
 {
 public:
-	GlRender(SDL_Renderer *renderer, size_t batch_size = 16384) : renderer(renderer)
-	{
-		points.reserve(batch_size);
-	}
+	static const int TILE_SIZE = 64;
+
+	// hierarchical z block size, the tiles are made of whole blocks
+	static const int HIZ_SIZE = 8;
+	static_assert(TILE_SIZE % HIZ_SIZE == 0, "tiles must hold whole hierarchical z blocks");
 
-	void line(vec3 a, vec3 b, SDL_Color color)
+	// Renderer can be null for offscreen rendering, end_frame then skips presentation.
+	// threads = 0 rasterizes with one thread per hardware core. The buffers are sized
+	// for the output resolution, frames can be rendered at any smaller one.
+	GlRender(SDL_Renderer *renderer = nullptr, unsigned threads = 0, int width = DEFAULT_WIDTH, int height = DEFAULT_HEIGHT);
+
+	~GlRender()
 	{
-		set_color(color);
-		SDL_RenderDrawLineF(renderer, a.x, a.y, b.x, b.y);
+		if (frame_texture != nullptr) SDL_DestroyTexture(frame_texture);
 	}
 
+	GlRender(const GlRender &) = delete;
+	GlRender &operator=(const GlRender &) = delete;
+
+	void line(vec3 a, vec3 b, SDL_Color color);
+
 	void triangle_frame(triangle t);
 
-	void triangle_textured(triangle t, const texture &texture, float texture_scale = 1.0f);
+	// Bins ts into screen tiles and rasterizes the tiles in parallel,
+	// every tile is owned by a single worker so no locking is needed.
+	// Triangles are drawn in the order of the indices in order when given.
+	void rasterize(const triangle *ts, size_t count, const texture *texture = nullptr, float texture_scale = 1.0f, const uint32_t *order = nullptr);
+
+	// Returns the number of pixels that passed the depth test and were shaded. Depth
+	// is cleared lazily by rasterize(), direct calls need a tile it already drew into
+	// or clear_depth().
+	int triangle_textured(triangle t, const texture &texture, float texture_scale, rect clip);
+
+	// clears the depth of every tile now, rasterize() then leaves it as is until start_frame()
+	void clear_depth();
 
 	// triangle scanline rasterization with top-left rule
-	void triangle_filled(triangle t);
+	void triangle_filled(triangle t, rect clip);
+
+	// SIMD edge function rasterization with top-left rule, same coverage as the scanline path
+	int triangle_textured_halfspace(triangle t, const texture &texture, float texture_scale, rect clip);
+
+	void triangle_filled_halfspace(triangle t, rect clip);
+
+	// rasterizer used by rasterize()
+	raster_mode mode = raster_mode::scanline;
+
+	// scanline textured spans divide out perspective every span_subdiv pixels at most,
+	// fewer when the affine error would exceed span_error texels; 1 divides every pixel
+	int span_subdiv = 16;
+	float span_error = 0.5f;
+
+	// sample a mip level picked per triangle instead of the full resolution texture
+	bool mipmaps = true;
+
+	// reject depth tested triangles and spans behind the farthest depth of their
+	// 8x8 blocks and tiles, the filled paths draw in order without depth. Off by
+	// default, it only pays off when triangles arrive front to back.
+	bool hiz = false;
+
+	// ARGB8888, same layout as frame_texture
+	static uint32_t pack_color(SDL_Color color)
+	{
+		return (uint32_t)color.a << 24 | (uint32_t)color.r << 16 | (uint32_t)color.g << 8 | (uint32_t)color.b;
+	}
+
+	void put_pixel(int x, int y, SDL_Color color)
+	{
+		if (x < 0 || x >= frame_width || y < 0 || y >= frame_height) return;
+		color_buffer[y * frame_width + x] = pack_color(color);
+	}
+
+	void clear(SDL_Color color);
+
+	// resolution frames are rendered at, rows are frame_width pixels apart
+	int width() const { return frame_width; }
+	int height() const { return frame_height; }
+
+	// resolution of the buffers and of the presented image
+	int output_width() const { return max_width; }
+	int output_height() const { return max_height; }
 
-	void set_color(SDL_Color color)
+	rect viewport() const
 	{
-		SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+		return {0, 0, frame_width, frame_height};
 	}
 
-	void clear(SDL_Color color)
+	// viewport frames will have after set_render_scale(scale)
+	rect viewport(float scale) const;
+
+	// Renders the next frames at scale times the output resolution, clamped to
+	// [1/16, 1], end_frame() stretches them to the whole output. Call between frames.
+	void set_render_scale(float scale);
+
+	// Textured pixels shaded by rasterize() since start_frame(), every pixel shaded
+	// more than once is overdraw the depth test could not reject
+	uint64_t pixels_shaded() const
+	{
+		uint64_t shaded = 0;
+		for_range(tile, 0, tiles_x * tiles_y) shaded += tile_shaded[tile];
+		return shaded;
+	}
+
+	// pixels holding a depth tested triangle, scans the depth of every tile cleared this frame
+	size_t pixels_covered() const;
+
+#ifdef GL3D_PROFILE
+	// measured by rasterize() since start_frame()
+	frame_profile profile;
+#endif
+
+	// per frame scratch memory, released by start_frame()
+	FrameArena &frame_arena()
 	{
-		set_color(color);
-		SDL_RenderClear(renderer);
+		return arena;
 	}
 
 	void start_frame()
 	{
-		std::memset(depth_buffer.data(), 0, depth_buffer.size() * sizeof(float));
+		arena.reset();
+		std::memset(tile_depth_cleared.data(), 0, tiles_x * tiles_y);
+		std::memset(tile_shaded.data(), 0, tiles_x * tiles_y * sizeof(uint32_t));
+#ifdef GL3D_PROFILE
+		profile.reset();
+#endif
 	}
 
 	void end_frame()
 	{
+		if (renderer == nullptr) return;
+
+		// only the rendered part of the texture is uploaded and upscaled to the window
+		const SDL_Rect frame = {0, 0, frame_width, frame_height};
+		SDL_UpdateTexture(frame_texture, &frame, color_buffer.data(), frame_width * sizeof(uint32_t));
+		SDL_RenderCopy(renderer, frame_texture, &frame, nullptr);
 		SDL_RenderPresent(renderer);
 	}
 
+	// binary PPM (P6) of the current color buffer
+	bool dump_ppm(const char *path) const;
+
 private:
 	SDL_Renderer *renderer;
-	std::vector<SDL_Point> points;
-	std::array<float, WIDTH * HEIGHT> depth_buffer;
+	SDL_Texture *frame_texture = nullptr;
+
+	int max_width, max_height;
+	int frame_width, frame_height;
+	// tiles and hierarchical z blocks of the current resolution
+	int tiles_x, tiles_y;
+	int hiz_x, hiz_y;
+
+	aligned_array<uint32_t> color_buffer;
+	aligned_array<float> depth_buffer;
+
+	// The depth of a tile is only cleared when rasterize() first draws into it in a
+	// frame, so clearing costs the rendered area instead of the whole buffer. The depth
+	// and hierarchical z of tiles not cleared this frame are garbage.
+	aligned_array<uint8_t> tile_depth_cleared;
+
+	// Farthest depth (smallest 1/w) of every 8x8 block and tile. Triangles only count
+	// their writes, a failed test recomputes a block after HIZ_BLOCK_REBUILD triangles
+	// touched it and a tile from its blocks after HIZ_TILE_REBUILD. Depth only gets
+	// nearer, so a stale value is farther than the real one and rejection stays
+	// conservative. Blocks are owned by the worker of their tile.
+	static const int HIZ_BLOCK_REBUILD = 4;
+	static const int HIZ_TILE_REBUILD = 32;
+	aligned_array<float> hiz_blocks;
+	aligned_array<float> hiz_tiles;
+	aligned_array<uint8_t> hiz_block_writes;
+	aligned_array<uint16_t> hiz_tile_writes;
+
+	// written only by the worker owning the tile
+	aligned_array<uint32_t> tile_shaded;
 
-	void batch_add(int x, int y)
+	FrameArena arena;
+	ThreadPool pool;
+	// bin of tile i is [bin_start[i], bin_start[i + 1]) in the frame arena index list,
+	// triangles are kept in drawing order
+	aligned_array<uint32_t> bin_start;
+
+	void span_fill(int y, int x_min, int x_max, uint32_t color)
 	{
-		if (points.size() == points.capacity()) batch_flush();
-		points.push_back({x, y});
+		uint32_t *row = &color_buffer[y * frame_width];
+		for (int x = x_min; x < x_max; x++) row[x] = color;
 	}
 
-	void batch_flush()
+	// clears the depth and hierarchical z of tile
+	void clear_tile_depth(int tile);
+
+	int triangle_lod(const triangle &t, const texture &texture, float texture_scale) const;
+
+	// fills the bins of the tiles, returns the triangle index list bin_start points into
+	const uint32_t *bin_triangles(const triangle *ts, size_t count, const uint32_t *order);
+
+	// true when depth is not nearer than every pixel of the block, the stale value is
+	// tried first since it can only be farther than the real one
+	bool hiz_block_hides(int bx, int by, float depth)
 	{
-		SDL_RenderDrawPoints(renderer, points.data(), points.size());
-		points.clear();
+		const int block = by * hiz_x + bx;
+		if (depth <= hiz_blocks[block]) return true;
+		if (hiz_block_writes[block] < HIZ_BLOCK_REBUILD) return false;
+
+		hiz_refresh_block(bx, by);
+		return depth <= hiz_blocks[block];
 	}
 
-	void triangle_bottom_flat(triangle t);
+	bool hiz_tile_hides(int tile, float depth);
+
+	void hiz_refresh_block(int bx, int by);
+
+	// counts a triangle covering bounds, bounds lie inside of tile. The counters saturate,
+	// a tile can take more triangles than they hold before it is rebuilt.
+	void hiz_mark(const rect &bounds, int tile)
+	{
+		for (int by = bounds.y0 / HIZ_SIZE; by <= (bounds.y1 - 1) / HIZ_SIZE; by++)
+		{
+			for (int bx = bounds.x0 / HIZ_SIZE; bx <= (bounds.x1 - 1) / HIZ_SIZE; bx++)
+			{
+				uint8_t &writes = hiz_block_writes[by * hiz_x + bx];
+				if (writes < UINT8_MAX) writes++;
+			}
+		}
+		if (hiz_tile_writes[tile] < UINT16_MAX) hiz_tile_writes[tile]++;
+	}
+
+	// pixels of clip that t may cover
+	rect triangle_bounds(const triangle &t, const rect &clip);
+
+	// true when no pixel of t inside bounds can pass the depth test
+	bool triangle_hidden(const triangle &t, const rect &bounds, int tile);
+
+	int span_textured(int y, float ax, float bx, vec2 s, vec2 e, const texture &texture, int level, float texture_scale, const rect &clip);
+
+	void triangle_bottom_flat(triangle t, uint32_t color, rect clip);
 
-	void triangle_top_flat(triangle t);
+	void triangle_top_flat(triangle t, uint32_t color, rect clip);
 };
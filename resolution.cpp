@@ -0,0 +1,25 @@
+#include <cmath>
+#include <algorithm>
+
+#include "resolution.hpp"
+#include "base.hpp"
+
+float ResolutionController::update(float frame_ms)
+{
+	average_ms = average_ms == 0.0f ? frame_ms : average_ms + (frame_ms - average_ms) * 0.25f;
+
+	// a single slow frame over the budget is acted on right away, the average lags
+	const float ms = frame_ms > target_ms ? std::max(frame_ms, average_ms) : average_ms;
+	float wanted = current * sqrtf(target_ms * HEADROOM / std::max(ms, 0.01f));
+
+	// drop fast, recover slowly so the scale does not oscillate around the budget
+	wanted = std::min(wanted, current * 1.05f);
+	wanted = clamp(wanted, max_scale, min_scale);
+
+	// ignore changes too small to matter, every one of them resizes the frame
+	if (fabsf(wanted - current) < 0.02f * current) return current;
+
+	average_ms *= (wanted * wanted) / (current * current);
+	current = wanted;
+	return current;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Dynamic resolution: picks the render scale of the next frame so that frames stay
+// within a time budget, sharpness is given up before the deadline is missed.
+// Frame cost is taken to grow with the pixel count, the square of the scale.
+class ResolutionController
+{
+public:
+	// aims a bit below target_ms so that frame time noise does not miss the budget
+	static constexpr float HEADROOM = 0.85f;
+
+	ResolutionController(float target_ms, float min_scale = 0.25f, float max_scale = 1.0f)
+	: target_ms(target_ms), min_scale(min_scale), max_scale(max_scale)
+	{
+	}
+
+	// Feeds the render time of the last frame, returns the scale for the next one
+	float update(float frame_ms);
+
+	float scale() const
+	{
+		return current;
+	}
+
+private:
+	float target_ms;
+	float min_scale, max_scale;
+
+	float current = 1.0f;
+	// smoothed frame time, rescaled to the current scale whenever it changes
+	float average_ms = 0.0f;
+};
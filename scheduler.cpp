@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#include "scheduler.hpp"
+
+FrameScheduler::FrameScheduler(frame_pacing pacing, float frame_ms, float step_ms)
+: pacing(pacing), step(step_ms), frequency(SDL_GetPerformanceFrequency())
+{
+	frame_ticks = (Uint64)(frame_ms / 1000.0 * frequency);
+	next_frame = last_step = SDL_GetPerformanceCounter();
+}
+
+bool FrameScheduler::wait_event(SDL_Event &event, bool idle)
+{
+	if (idle)
+	{
+		if (!SDL_WaitEvent(&event)) return false;
+
+		// the time spent waiting is not simulated, but the event gets a step right away
+		// so a key pressed while idle moves the view on this frame
+		last_step = next_frame = SDL_GetPerformanceCounter();
+		pending_ms = step;
+		return true;
+	}
+
+	// vsync paces in SDL_RenderPresent
+	if (pacing != frame_pacing::capped) return SDL_PollEvent(&event) == 1;
+
+	const Uint64 now = SDL_GetPerformanceCounter();
+	if (now >= next_frame) return false;
+
+	// whole milliseconds, rounded up so the frame is never early
+	const int timeout = (int)((next_frame - now) * 1000 / frequency) + 1;
+	return SDL_WaitEventTimeout(&event, timeout) == 1;
+}
+
+int FrameScheduler::steps()
+{
+	const Uint64 now = SDL_GetPerformanceCounter();
+	pending_ms += (double)(now - last_step) * 1000.0 / frequency;
+	last_step = now;
+
+	const int n = std::min((int)(pending_ms / step), MAX_STEPS);
+	pending_ms = std::min(pending_ms - n * step, (double)step);
+	return n;
+}
+
+void FrameScheduler::frame_done()
+{
+	if (pacing != frame_pacing::capped) return;
+
+	// a late frame does not make the following ones early
+	next_frame = std::max(next_frame + frame_ticks, SDL_GetPerformanceCounter());
+}
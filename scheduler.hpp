@@ -0,0 +1,50 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+enum class frame_pacing {
+	// a frame every frame_ms, the thread waits on events in between
+	capped,
+	// as fast as the display refreshes, SDL_RenderPresent blocks until the next refresh
+	vsync,
+	// as fast as possible
+	uncapped,
+};
+
+// Drives the interactive loop. Events are waited for instead of polled until the
+// next frame is due, and the simulation advances in fixed steps of step_ms
+// whatever the frame rate.
+class FrameScheduler
+{
+public:
+	// steps beyond this per frame are dropped, the simulation slows down instead of spiraling
+	static const int MAX_STEPS = 8;
+
+	FrameScheduler(frame_pacing pacing, float frame_ms, float step_ms);
+
+	// Waits for the next event until the next frame is due, false once it is. When
+	// idle nothing would change on screen and it waits for an event without deadline.
+	bool wait_event(SDL_Event &event, bool idle);
+
+	// number of fixed steps to simulate since the last call
+	int steps();
+
+	// schedules the next frame after one was rendered
+	void frame_done();
+
+	float step_ms() const
+	{
+		return step;
+	}
+
+private:
+	frame_pacing pacing;
+	float step;
+
+	Uint64 frequency;
+	// performance counter ticks
+	Uint64 frame_ticks;
+	Uint64 next_frame;
+	Uint64 last_step;
+	double pending_ms = 0.0;
+};
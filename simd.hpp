@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// 4-wide float vector, SSE2 when available and plain arrays otherwise.
+// Comparisons return lane masks with all bits set.
+struct f32x4 {
+#if defined(__SSE2__)
+	__m128 v;
+
+	static f32x4 set1(float f)
+	{
+		return {_mm_set1_ps(f)};
+	}
+
+	static f32x4 set(float a, float b, float c, float d)
+	{
+		return {_mm_setr_ps(a, b, c, d)};
+	}
+
+	static f32x4 load(const float *p)
+	{
+		return {_mm_loadu_ps(p)};
+	}
+
+	void store(float *p) const
+	{
+		_mm_storeu_ps(p, v);
+	}
+
+	f32x4 operator+(f32x4 o) const { return {_mm_add_ps(v, o.v)}; }
+	f32x4 operator-(f32x4 o) const { return {_mm_sub_ps(v, o.v)}; }
+	f32x4 operator*(f32x4 o) const { return {_mm_mul_ps(v, o.v)}; }
+	f32x4 operator/(f32x4 o) const { return {_mm_div_ps(v, o.v)}; }
+	f32x4 operator&(f32x4 o) const { return {_mm_and_ps(v, o.v)}; }
+	f32x4 operator|(f32x4 o) const { return {_mm_or_ps(v, o.v)}; }
+
+	f32x4 operator>(f32x4 o) const { return {_mm_cmpgt_ps(v, o.v)}; }
+	f32x4 operator>=(f32x4 o) const { return {_mm_cmpge_ps(v, o.v)}; }
+	f32x4 operator<(f32x4 o) const { return {_mm_cmplt_ps(v, o.v)}; }
+	f32x4 operator==(f32x4 o) const { return {_mm_cmpeq_ps(v, o.v)}; }
+
+	static f32x4 min(f32x4 a, f32x4 b) { return {_mm_min_ps(a.v, b.v)}; }
+	static f32x4 max(f32x4 a, f32x4 b) { return {_mm_max_ps(a.v, b.v)}; }
+
+	// mask ? a : b
+	static f32x4 select(f32x4 mask, f32x4 a, f32x4 b)
+	{
+		return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+	}
+
+	// one bit per lane
+	int movemask() const
+	{
+		return _mm_movemask_ps(v);
+	}
+
+	// truncates towards zero
+	void to_int(int32_t *p) const
+	{
+		_mm_storeu_si128((__m128i *)p, _mm_cvttps_epi32(v));
+	}
+
+	// valid for |x| < 2^31
+	f32x4 floor() const
+	{
+		__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+		__m128 one = _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f));
+		return {_mm_sub_ps(t, one)};
+	}
+#else
+	float v[4];
+
+	static f32x4 set1(float f)
+	{
+		return {{f, f, f, f}};
+	}
+
+	static f32x4 set(float a, float b, float c, float d)
+	{
+		return {{a, b, c, d}};
+	}
+
+	static f32x4 load(const float *p)
+	{
+		return {{p[0], p[1], p[2], p[3]}};
+	}
+
+	void store(float *p) const
+	{
+		for (int i = 0; i < 4; i++) p[i] = v[i];
+	}
+
+	template<typename F>
+	static f32x4 map(f32x4 a, f32x4 b, F f)
+	{
+		f32x4 r;
+		for (int i = 0; i < 4; i++) r.v[i] = f(a.v[i], b.v[i]);
+		return r;
+	}
+
+	static float bits(bool b)
+	{
+		uint32_t u = b ? 0xffffffffu : 0;
+		float f;
+		__builtin_memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+
+	static uint32_t as_uint(float f)
+	{
+		uint32_t u;
+		__builtin_memcpy(&u, &f, sizeof(u));
+		return u;
+	}
+
+	f32x4 operator+(f32x4 o) const { return map(*this, o, [](float a, float b) { return a + b; }); }
+	f32x4 operator-(f32x4 o) const { return map(*this, o, [](float a, float b) { return a - b; }); }
+	f32x4 operator*(f32x4 o) const { return map(*this, o, [](float a, float b) { return a * b; }); }
+	f32x4 operator/(f32x4 o) const { return map(*this, o, [](float a, float b) { return a / b; }); }
+
+	f32x4 operator&(f32x4 o) const
+	{
+		return map(*this, o, [](float a, float b) { return bits(as_uint(a) & as_uint(b)); });
+	}
+
+	f32x4 operator|(f32x4 o) const
+	{
+		return map(*this, o, [](float a, float b) { return bits(as_uint(a) | as_uint(b)); });
+	}
+
+	f32x4 operator>(f32x4 o) const { return map(*this, o, [](float a, float b) { return bits(a > b); }); }
+	f32x4 operator>=(f32x4 o) const { return map(*this, o, [](float a, float b) { return bits(a >= b); }); }
+	f32x4 operator<(f32x4 o) const { return map(*this, o, [](float a, float b) { return bits(a < b); }); }
+	f32x4 operator==(f32x4 o) const { return map(*this, o, [](float a, float b) { return bits(a == b); }); }
+
+	static f32x4 min(f32x4 a, f32x4 b) { return map(a, b, [](float a, float b) { return b < a ? b : a; }); }
+	static f32x4 max(f32x4 a, f32x4 b) { return map(a, b, [](float a, float b) { return a < b ? b : a; }); }
+
+	static f32x4 select(f32x4 mask, f32x4 a, f32x4 b)
+	{
+		f32x4 r;
+		for (int i = 0; i < 4; i++) r.v[i] = as_uint(mask.v[i]) ? a.v[i] : b.v[i];
+		return r;
+	}
+
+	int movemask() const
+	{
+		int m = 0;
+		for (int i = 0; i < 4; i++) m |= (as_uint(v[i]) >> 31) << i;
+		return m;
+	}
+
+	void to_int(int32_t *p) const
+	{
+		for (int i = 0; i < 4; i++) p[i] = (int32_t)v[i];
+	}
+
+	f32x4 floor() const
+	{
+		return {{floorf(v[0]), floorf(v[1]), floorf(v[2]), floorf(v[3])}};
+	}
+#endif
+};
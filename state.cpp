@@ -1,20 +1,167 @@
 #include <cassert>
-#include <deque>
+#include <cstring>
 #include <vector>
 #include <algorithm>
 
 #include "render.hpp"
 #include "state.hpp"
 #include "vec3.hpp"
+#include "profile.hpp"
 
-void GlState::update(GlRender &render, float delta)
+namespace
 {
-	// delta ms -> s
-	angle += angle_factor * (delta / 1000.0f);
-	//std::cout << "delta = " << delta << ", angle = " << angle << std::endl;
+	// a * x + b * y + c * z + d >= 0 inside
+	struct plane {
+		float a, b, c, d;
+
+		// largest and smallest distance of the corners of a box
+		float max_distance(const vec3 &lo, const vec3 &hi) const
+		{
+			return a * (a >= 0 ? hi.x : lo.x) + b * (b >= 0 ? hi.y : lo.y) + c * (c >= 0 ? hi.z : lo.z) + d;
+		}
+
+		float min_distance(const vec3 &lo, const vec3 &hi) const
+		{
+			return a * (a >= 0 ? lo.x : hi.x) + b * (b >= 0 ? lo.y : hi.y) + c * (c >= 0 ? lo.z : hi.z) + d;
+		}
+	};
+
+	// model space version of the clip space planes of triangle::clip_frustum,
+	// a point p is transformed as (p, 1) * mvp so the planes are combinations of its columns
+	plane frustum_plane(const mat4 &mvp, int index, float guard_x, float guard_y)
+	{
+		float k[4] = {};
+		switch (index)
+		{
+			case 0: k[2] = 1; break;
+			case 1: k[3] = 1; k[2] = -1; break;
+			case 2: k[3] = guard_x; k[0] = 1; break;
+			case 3: k[3] = guard_x; k[0] = -1; break;
+			case 4: k[3] = guard_y; k[1] = 1; break;
+			case 5: k[3] = guard_y; k[1] = -1; break;
+			default:
+				assert(false && "Unreachable");
+		}
+
+		float p[4];
+		for_range(row, 0, 4)
+		{
+			p[row] = 0;
+			for_range(col, 0, 4) p[row] += mvp.m[row][col] * k[col];
+		}
+		return {p[0], p[1], p[2], p[3]};
+	}
+
+	struct visible_cluster {
+		uint32_t cluster;
+		// false when the whole cluster is inside the near/far planes and the guard band
+		bool clip;
+	};
+
+	// Walks the hierarchy, subtrees outside of a viewport plane are skipped. A plane
+	// stops being tested below a node that is completely inside of it.
+	void cull_clusters(const mesh &mesh, const plane view[6], const plane clip[6], frame_vector<visible_cluster> &visible)
+	{
+		if (mesh.nodes.empty()) return;
+
+		struct entry { uint32_t node; int view_mask, clip_mask; };
+		entry stack[mesh::BVH_DEPTH_MAX];
+		int top = 0;
+		stack[top++] = {0, 0x3f, 0x3f};
+
+		while (top > 0)
+		{
+			entry e = stack[--top];
+			const bvh_node &node = mesh.nodes[e.node];
 
-	auto mat_rot_z = mat4::rotation_z(angle * 0.5f);
-	auto mat_rot_x = mat4::rotation_x(angle);
+			bool outside = false;
+			for_range(i, 0, 6)
+			{
+				if (e.view_mask & (1 << i))
+				{
+					if (view[i].max_distance(node.bounds_min, node.bounds_max) < 0.0f)
+					{
+						outside = true;
+						break;
+					}
+					if (view[i].min_distance(node.bounds_min, node.bounds_max) >= 0.0f) e.view_mask &= ~(1 << i);
+				}
+
+				if ((e.clip_mask & (1 << i)) && clip[i].min_distance(node.bounds_min, node.bounds_max) >= 0.0f) e.clip_mask &= ~(1 << i);
+			}
+			if (outside) continue;
+
+			if (node.second == 0)
+			{
+				visible.push_back({node.cluster, e.clip_mask != 0});
+				continue;
+			}
+
+			// first child on top, clusters come out in mesh order
+			stack[top++] = {node.second, e.view_mask, e.clip_mask};
+			stack[top++] = {e.node + 1, e.view_mask, e.clip_mask};
+		}
+	}
+
+	// Stable LSD radix sort of the projected triangles, nearest first, returns the order
+	// to rasterize them in. The key is the top half of the float bits of the nearest 1/w,
+	// positive floats order like their bits, so depth is quantized to 7 mantissa bits and
+	// two 8 bit passes do. Key and index travel together to keep the passes sequential.
+	const uint32_t *sort_front_to_back(FrameArena &arena, const triangle *ts, size_t n)
+	{
+		uint64_t *items = arena.allocate<uint64_t>(n);
+		uint64_t *pass = arena.allocate<uint64_t>(n);
+		uint32_t *order = arena.allocate<uint32_t>(n);
+
+		uint32_t low[257] = {}, high[257] = {};
+		for_range(i, 0, (int)n)
+		{
+			const float nearest = std::max(ts[i].ts[0].w, std::max(ts[i].ts[1].w, ts[i].ts[2].w));
+			uint32_t bits;
+			std::memcpy(&bits, &nearest, sizeof(bits));
+
+			// greater 1/w is nearer and must come first
+			const uint32_t key = ~bits >> 16;
+			items[i] = (uint64_t)key << 32 | (uint32_t)i;
+			low[(key & 0xff) + 1]++;
+			high[(key >> 8) + 1]++;
+		}
+
+		for_range(b, 0, 256)
+		{
+			low[b + 1] += low[b];
+			high[b + 1] += high[b];
+		}
+
+		for_range(i, 0, (int)n) pass[low[(items[i] >> 32) & 0xff]++] = items[i];
+		for_range(i, 0, (int)n) order[high[(pass[i] >> 40) & 0xff]++] = (uint32_t)pass[i];
+		return order;
+	}
+}
+
+frame_view GlState::view(const GlRender &render, const rect &viewport) const
+{
+	frame_view view;
+	view.angle = angle;
+	view.camera = camera;
+	view.yaw = yaw;
+	view.width = viewport.x1;
+	view.height = viewport.y1;
+	view.aspect_ratio = (float)render.output_height() / (float)render.output_width();
+	return view;
+}
+
+void GlState::rasterize(GlRender &render, const frame_geometry &geometry) const
+{
+	render.rasterize(geometry.ts, geometry.count, loaded_texture, texture_scale, geometry.order);
+}
+
+void GlState::project(const frame_view &view, FrameArena &arena, ThreadPool &pool, frame_geometry &out)
+{
+	PROFILE_SCOPE(profile_stage::project);
+
+	auto mat_rot_z = mat4::rotation_z(view.angle * 0.5f);
+	auto mat_rot_x = mat4::rotation_x(view.angle);
 
 	auto mat_trans = mat4::translation(0.0f, 0.0f, 5.0f);
 	auto mat_world = (mat_rot_z * mat_rot_x) * mat_trans;
@@ -22,28 +169,65 @@ void GlState::update(GlRender &render, float delta)
 	vec3 up_dir = {0, 1, 0};
 	vec3 target_dir = {0, 0, 1};
 
-	auto mat_camera_rot = mat4::rotation_y(yaw);
-	look_dir = mat_camera_rot * target_dir;
+	vec3 camera = view.camera;
+	auto mat_camera_rot = mat4::rotation_y(view.yaw);
+	vec3 look_dir = mat_camera_rot * target_dir;
 	target_dir = camera + look_dir;
 
 	auto mat_camera = mat4::point_at(camera, target_dir, up_dir);
 	auto mat_view = mat_camera.quick_inverse();
 
-	std::vector<triangle> raster_vec;
-	for (auto &t : loaded_mesh.ts)
-	{
-		triangle trans_t;
-		for_range(i, 0, 3) trans_t.vs[i] = mat_world * t.vs[i];
+	auto mat_proj = mat4::projection(fov, view.aspect_ratio, near_plane, far_plane);
 
-		auto line1 = trans_t.vs[1] - trans_t.vs[0];
-		auto line2 = trans_t.vs[2] - trans_t.vs[0];
+	// model -> clip space in a single product
+	auto mat_world_view = mat_world * mat_view;
+	auto mat_mvp = mat_world_view * mat_proj;
 
-		auto normal = line1.cross_product(line2);
-		normal = normal.normalize();
+	clip_vs.resize(loaded_mesh.vs.size());
 
-		auto camera_ray = trans_t.vs[0] - camera;
-		if (normal.dot_product(camera_ray) < 0.0f)
+	// world is a rigid transform, so culling and lighting give the same result in
+	// model space against the face normals of the mesh
+	vec3 model_camera = mat_world.quick_inverse() * camera;
+
+	const bool with_texture = !loaded_mesh.uvs.empty();
+
+	// guard band extent in clip space units, the viewport is [-1, 1]
+	const float width = (float)view.width;
+	const float height = (float)view.height;
+	const float guard_x = guard_band ? 1.0f + GUARD_BAND / (0.5f * width) : 1.0f;
+	const float guard_y = guard_band ? 1.0f + GUARD_BAND / (0.5f * height) : 1.0f;
+
+	plane view_planes[6], clip_planes[6];
+	for_range(i, 0, 6)
+	{
+		view_planes[i] = frustum_plane(mat_mvp, i, 1.0f, 1.0f);
+		clip_planes[i] = frustum_plane(mat_mvp, i, guard_x, guard_y);
+	}
+
+	frame_vector<visible_cluster> visible(arena, 256);
+	{
+		PROFILE_SCOPE(profile_stage::cull);
+		cull_clusters(loaded_mesh, view_planes, clip_planes, visible);
+	}
+
+	// screen space triangles of a cluster with transformed vertices into out, returns their number
+	auto project_triangles = [&](const mesh_cluster &cluster, bool clip, triangle *out)
+	{
+		uint32_t count = 0;
+		for_range(n, (int)cluster.triangle_begin, (int)cluster.triangle_end)
 		{
+			const uint32_t *index = &loaded_mesh.indices[n * 3];
+
+			vec3 normal = loaded_mesh.normals[n];
+			vec3 v0 = loaded_mesh.vs[index[0]];
+
+			auto camera_ray = v0 - model_camera;
+			if (normal.dot_product(camera_ray) >= 0.0f)
+			{
+				PROFILE_COUNT(profile_counter::triangles_culled, 1);
+				continue;
+			}
+
 			// dynamic light position
 			vec3 light = camera_ray * -1;
 			light = light.normalize();
@@ -51,25 +235,31 @@ void GlState::update(GlRender &render, float delta)
 			float light_dp = std::max(0.1f, normal.dot_product(light));
 			uint8_t greyscale = std::min(255.0f, (light_dp + 0.1f) * 255);
 
-			triangle view_t;
-			for_range(i, 0, 3) view_t.vs[i] = mat_view * trans_t.vs[i];
+			triangle clip_t;
+			clip_t.color = {greyscale, greyscale, greyscale};
+			for_range(i, 0, 3) clip_t.vs[i] = clip_vs[index[i]];
 
 			// transfer texture information
-			for_range(i, 0, 3) view_t.ts[i] = t.ts[i];
+			if (with_texture)
+			{
+				for_range(i, 0, 3) clip_t.ts[i] = loaded_mesh.uvs[index[i]];
+			}
 
-			triangle clipped[2];
-			int clipped_n = triangle::clip_plane({0.0f, 0.0f, near_plane}, {0.0f, 0.0f, 1.0f}, view_t, clipped[0], clipped[1]);
+			triangle clipped[triangle::CLIP_MAX];
+			int clipped_n = 1;
+			if (clip)
+			{
+				PROFILE_COUNT(profile_counter::triangles_clipped, 1);
+				clipped_n = triangle::clip_frustum(clip_t, clipped, guard_x, guard_y);
+			}
+			else clipped[0] = clip_t;
 
 			for_range(n, 0, clipped_n)
 			{
-				triangle proj_t;
-				proj_t.color = {greyscale, greyscale, greyscale};
+				triangle &proj_t = clipped[n];
 
 				for_range(i, 0, 3)
 				{
-					proj_t.vs[i] = mat_proj * clipped[n].vs[i];
-					proj_t.ts[i] = clipped[n].ts[i];
-
 					proj_t.ts[i].u /= proj_t.vs[i].w;
 					proj_t.ts[i].v /= proj_t.vs[i].w;
 					proj_t.ts[i].w = 1.0f / proj_t.vs[i].w;
@@ -88,121 +278,131 @@ void GlState::update(GlRender &render, float delta)
 				for_range(i, 0, 3)
 				{
 					proj_t.vs[i] = proj_t.vs[i] + offset;
-					proj_t.vs[i].x *= 0.5f * (float)WIDTH;
-					proj_t.vs[i].y *= 0.5f * (float)HEIGHT;
+					proj_t.vs[i].x *= 0.5f * width;
+					proj_t.vs[i].y *= 0.5f * height;
 				}
 
-				raster_vec.push_back(proj_t);
-				//std::cout << proj_t << std::endl;
+				out[count++] = proj_t;
 			}
 		}
-	}
+		return count;
+	};
 
-	//std::sort(raster_vec.begin(), raster_vec.end(), [](triangle &t1, triangle &t2)
-	//{
-	//	float z1 = (t1.vs[0].z + t1.vs[1].z + t1.vs[2].z) / 3.0f;
-	//	float z2 = (t2.vs[0].z + t2.vs[1].z + t2.vs[2].z) / 3.0f;
-	//	return z1 > z2;
-	//});
-
-	for (auto &prep_t : raster_vec)
+	// screen space triangles of a visible cluster into out, returns their number
+	auto project_cluster = [&](const visible_cluster &v, triangle *out)
 	{
-		std::deque<triangle> triangles;
-		triangles.push_back(prep_t);
+		const mesh_cluster &cluster = loaded_mesh.clusters[v.cluster];
 
-		int triangles_n = 1;
-		for_range(plane, 0, 4)
+		// only the vertices of visible clusters are transformed, clusters own disjoint ranges
 		{
-			triangle clipped[2];
-			int clipped_n = 0;
-
-			while (triangles_n > 0)
-			{
-				auto front = triangles.front();
-				triangles.pop_front();
-				triangles_n--;
+			PROFILE_SCOPE(profile_stage::transform);
+			mat_mvp.transform(loaded_mesh.vs, clip_vs, cluster.vertex_begin, cluster.vertex_end);
+		}
 
-				switch (plane)
-				{
-					case 0:
-						clipped_n = triangle::clip_plane({0, 0, 0}, {0, 1, 0}, front, clipped[0], clipped[1]);
-						break;
+		// timed per cluster, a timer per triangle costs about as much as the clipping
+		if (v.clip)
+		{
+			PROFILE_SCOPE(profile_stage::clip);
+			return project_triangles(cluster, true, out);
+		}
+		return project_triangles(cluster, false, out);
+	};
+
+	// Every cluster is projected by whichever worker takes it next into its own slice
+	// of the output, sized for the worst case of clipping. The slices are then packed
+	// in cluster order, so the triangles do not depend on the number of threads.
+	const size_t clusters = visible.size();
+	uint32_t *slice_start = arena.allocate<uint32_t>(clusters + 1);
+	uint32_t *slice_count = arena.allocate<uint32_t>(clusters);
+
+	slice_start[0] = 0;
+	for_range(c, 0, (int)clusters)
+	{
+		const mesh_cluster &cluster = loaded_mesh.clusters[visible[c].cluster];
+		const uint32_t n = cluster.triangle_end - cluster.triangle_begin;
+		slice_start[c + 1] = slice_start[c] + (visible[c].clip ? n * triangle::CLIP_MAX : n);
+	}
 
-					case 1:
-						clipped_n = triangle::clip_plane({0, (float)HEIGHT - 1, 0}, {0, -1, 0}, front, clipped[0], clipped[1]);
-						break;
+#ifdef GL3D_PROFILE
+	// triangles of the clusters outside of the frustum, backfaces are counted per cluster
+	size_t outside = loaded_mesh.indices.size() / 3;
+	for (auto &v : visible) outside -= loaded_mesh.clusters[v.cluster].triangle_end - loaded_mesh.clusters[v.cluster].triangle_begin;
+	PROFILE_COUNT(profile_counter::triangles_in, loaded_mesh.indices.size() / 3);
+	PROFILE_COUNT(profile_counter::triangles_culled, outside);
+#endif
+
+	// lives in the frame arena, no heap allocation in steady state
+	triangle *ts = arena.allocate<triangle>(slice_start[clusters]);
+	pool.run(clusters, [&](size_t c, unsigned)
+	{
+		slice_count[c] = project_cluster(visible[c], ts + slice_start[c]);
+		PROFILE_FLUSH(out.profile);
+	});
 
-					case 2:
-						clipped_n = triangle::clip_plane({0, 0, 0}, {1, 0, 0}, front, clipped[0], clipped[1]);
-						break;
+	size_t count = 0;
+	for_range(c, 0, (int)clusters)
+	{
+		if (slice_start[c] != count) std::memmove((void *)(ts + count), ts + slice_start[c], slice_count[c] * sizeof(triangle));
+		count += slice_count[c];
+	}
 
-					case 3:
-						clipped_n = triangle::clip_plane({(float)WIDTH - 1, 0, 0}, {-1, 0, 0}, front, clipped[0], clipped[1]);
-						break;
+	out.order = nullptr;
+	if (sort && with_texture)
+	{
+		PROFILE_SCOPE(profile_stage::sort);
+		out.order = sort_front_to_back(arena, ts, count);
+	}
 
-					default:
-						assert(false && "Unreachable");
-				}
+	out.ts = ts;
+	out.count = count;
+	PROFILE_COUNT(profile_counter::triangles_emitted, count);
+}
 
-				for_range(n, 0, clipped_n) triangles.push_back(clipped[n]);
-			}
-			triangles_n = triangles.size();
-		}
+namespace
+{
+	const SDL_Scancode movement_keys[] = {
+		SDL_SCANCODE_W, SDL_SCANCODE_S, SDL_SCANCODE_A, SDL_SCANCODE_D,
+		SDL_SCANCODE_UP, SDL_SCANCODE_DOWN, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT,
+	};
+}
 
-		for (auto &t : triangles)
-		{
-			if (loaded_texture != nullptr) render.triangle_textured(t, *loaded_texture, texture_scale);
-			else render.triangle_filled(t);
+bool GlState::animating(const Uint8 *keys) const
+{
+	if (angle_factor != 0.0f) return true;
+	if (keys == nullptr) return false;
 
-			//t.color = {0, 255, 0};
-			//render.triangle_frame(t);
-		}
+	for (auto key : movement_keys)
+	{
+		if (keys[key]) return true;
 	}
+	return false;
 }
 
-void GlState::keypress(SDL_KeyboardEvent &event, float delta)
+void GlState::step(float delta, const Uint8 *keys)
 {
-	const float camera_vel = 0.08f;
-	const float yaw_vel = 0.02f;
+	// delta ms -> s
+	angle += angle_factor * (delta / 1000.0f);
+	if (keys == nullptr) return;
 
-	auto forward = look_dir * (camera_vel * delta);
-	switch (event.keysym.sym)
+	// units and radians per ms a key is held
+	const float camera_vel = 0.005f;
+	const float yaw_vel = 0.0015f;
+
+	vec3 target_dir = {0, 0, 1};
+	vec3 forward = (mat4::rotation_y(yaw) * target_dir) * (camera_vel * delta);
+	auto held = [&](SDL_Scancode key)
 	{
-		case 'w':
-			camera = camera + forward;
-			break;
-
-		case 'a':
-			yaw -= yaw_vel * delta;
-			break;
-
-		case 's':
-			camera = camera - forward;
-			break;
-
-		case 'd':
-			yaw += yaw_vel * delta;
-			break;
-
-		case SDLK_UP:
-			camera.y += camera_vel * delta;
-			break;
-
-		case SDLK_LEFT:
-			// x is inverted
-			camera.x += camera_vel * delta;
-			break;
-
-		case SDLK_DOWN:
-			camera.y -= camera_vel * delta;
-			break;
-
-		case SDLK_RIGHT:
-			// x is inverted
-			camera.x -= camera_vel * delta;
-			break;
-
-		default:
-			break;
-	}
+		return keys[key] != 0;
+	};
+
+	if (held(SDL_SCANCODE_W)) camera = camera + forward;
+	if (held(SDL_SCANCODE_S)) camera = camera - forward;
+	if (held(SDL_SCANCODE_A)) yaw -= yaw_vel * delta;
+	if (held(SDL_SCANCODE_D)) yaw += yaw_vel * delta;
+
+	if (held(SDL_SCANCODE_UP)) camera.y += camera_vel * delta;
+	if (held(SDL_SCANCODE_DOWN)) camera.y -= camera_vel * delta;
+	// x is inverted
+	if (held(SDL_SCANCODE_LEFT)) camera.x += camera_vel * delta;
+	if (held(SDL_SCANCODE_RIGHT)) camera.x -= camera_vel * delta;
 }
@@ -1,30 +1,82 @@
 #pragma once
 
 #include <SDL2/SDL.h>
+#include <vector>
 
 #include "mat4.hpp"
 #include "vec3.hpp"
+#include "stream.hpp"
 #include "mesh.hpp"
 #include "texture.hpp"
 #include "render.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
+
+// what the geometry of a frame depends on besides the mesh, copied so the
+// simulation can step while a frame is being projected
+struct frame_view {
+	float angle;
+	vec3 camera;
+	float yaw;
+	// render resolution and output aspect ratio
+	int width, height;
+	float aspect_ratio;
+};
+
+// screen space triangles of a frame, in the arena they were projected into
+struct frame_geometry {
+	const triangle *ts = nullptr;
+	size_t count = 0;
+	// drawing order when sorted, null for submission order
+	const uint32_t *order = nullptr;
+#ifdef GL3D_PROFILE
+	// measured by GlState::project()
+	frame_profile profile;
+#endif
+};
 
 class GlState
 {
 public:
-	GlState(mesh &mesh, texture *texture = nullptr, float angle_factor = 0.0f, float fov = 90.0f, float near = 0.1f, float far = 1000.0f)
-	: loaded_mesh(mesh), loaded_texture(texture), angle_factor(angle_factor), near_plane(near), far_plane(far)
+	GlState(const mesh &mesh, texture *texture = nullptr, float angle_factor = 0.0f, float fov = 90.0f, float near = 0.1f, float far = 1000.0f)
+	: loaded_mesh(mesh), loaded_texture(texture), angle_factor(angle_factor), fov(fov), near_plane(near), far_plane(far)
 	{
-		const float aspect_ratio = (float)HEIGHT / (float)WIDTH;
-		mat_proj = mat4::projection(fov, aspect_ratio, near, far);
 		if (loaded_texture != nullptr)  texture_scale /= loaded_mesh.texture_max;
 	}
 
-	void update(GlRender &render, float delta);
+	// Advances the simulation by delta ms, moving the camera by the keys held in keys
+	// (SDL_GetKeyboardState, null for none)
+	void step(float delta, const Uint8 *keys = nullptr);
+
+	// true while the next step() changes the view, the mesh spins or a movement key is held
+	bool animating(const Uint8 *keys) const;
+
+	// A frame is project() of a view, then rasterize() of the geometry once the
+	// renderer is at the view resolution. FramePipeline overlaps the two.
 
-	void keypress(SDL_KeyboardEvent &event, float delta);
+	// current state rendered into viewport, a render resolution of render
+	frame_view view(const GlRender &render, const rect &viewport) const;
+
+	// Transforms, culls, clips and projects the mesh into out, allocating from arena,
+	// the visible clusters are split across pool. Only reads the state through view,
+	// but a single projection may run at a time.
+	void project(const frame_view &view, FrameArena &arena, ThreadPool &pool, frame_geometry &out);
+
+	// render has to be at the resolution the geometry was projected for
+	void rasterize(GlRender &render, const frame_geometry &geometry) const;
+
+	// only clip triangles crossing the near/far planes or a guard band of
+	// GUARD_BAND pixels around the viewport, the rasterizer scissors the rest
+	static const int GUARD_BAND = 4096;
+	bool guard_band = true;
+
+	// Rasterize textured triangles front to back, so the depth test rejects hidden
+	// pixels before their texture fetch. Off by default, the triangles are then read
+	// out of memory order, which costs more than it saves on meshes without overdraw.
+	bool sort = false;
 
 private:
-	mesh loaded_mesh;
+	const mesh &loaded_mesh;
 	texture *loaded_texture;
 	float texture_scale = 1.0f;
 
@@ -32,10 +84,13 @@ private:
 	float angle_factor;
 
 	vec3 camera{};
-	vec3 look_dir = {0, 0, 1};
 	float yaw = 0;
 
-	mat4 mat_proj;
+	// the projection follows the output aspect ratio, the render resolution may change every frame
+	float fov;
 	float near_plane;
 	float far_plane;
+
+	// post-transform vertex cache, every mesh vertex is transformed once per frame
+	vec4_stream clip_vs;
 };
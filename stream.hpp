@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include "vec3.hpp"
+
+// Read only view of a point stream, either owned by a vec3_stream or mapped from a file
+struct vec3_view {
+	const float *x = nullptr, *y = nullptr, *z = nullptr;
+	size_t n = 0;
+
+	size_t size() const
+	{
+		return n;
+	}
+
+	vec3 operator[](size_t i) const
+	{
+		return {x[i], y[i], z[i]};
+	}
+};
+
+// Read only view of a contiguous array
+template<typename T>
+struct array_view {
+	const T *items = nullptr;
+	size_t n = 0;
+
+	size_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	const T *data() const { return items; }
+
+	const T &operator[](size_t i) const { return items[i]; }
+
+	const T *begin() const { return items; }
+	const T *end() const { return items + n; }
+};
+
+// Structure of arrays point stream, one array per component so batches of
+// points can be loaded straight into SIMD registers
+struct vec3_stream {
+	std::vector<float> x, y, z;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	void resize(size_t n)
+	{
+		x.resize(n);
+		y.resize(n);
+		z.resize(n);
+	}
+
+	void push_back(const vec3 &v)
+	{
+		x.push_back(v.x);
+		y.push_back(v.y);
+		z.push_back(v.z);
+	}
+
+	vec3 operator[](size_t i) const
+	{
+		return {x[i], y[i], z[i]};
+	}
+
+	operator vec3_view() const
+	{
+		return {x.data(), y.data(), z.data(), x.size()};
+	}
+};
+
+// Homogeneous point stream, the output of projective transforms
+struct vec4_stream {
+	std::vector<float> x, y, z, w;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	void resize(size_t n)
+	{
+		x.resize(n);
+		y.resize(n);
+		z.resize(n);
+		w.resize(n);
+	}
+
+	vec3 operator[](size_t i) const
+	{
+		return {x[i], y[i], z[i], w[i]};
+	}
+};
@@ -1,57 +1,131 @@
 #include <SDL2/SDL_image.h>
 #include <iostream>
-#include <cassert>
+#include <cmath>
 
 #include "texture.hpp"
+#include "base.hpp"
+
+static int pow2_ceil(int n)
+{
+	int p = 4;
+	while (p < n) p <<= 1;
+	return p;
+}
+
+static int log2_int(int n)
+{
+	int l = 0;
+	while ((1 << l) < n) l++;
+	return l;
+}
 
 bool texture::load_from_file(const char *path)
 {
-	surface = IMG_Load(path);
+	SDL_Surface *loaded = IMG_Load(path);
 
-	if (surface == nullptr)
+	if (loaded == nullptr)
 	{
 		std::cerr << "Surface " << path << " not loaded: " << IMG_GetError() << std::endl;
 		return false;
 	}
 
+	SDL_Surface *surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(loaded);
+
+	if (surface == nullptr)
+	{
+		std::cerr << "Surface " << path << " not converted: " << SDL_GetError() << std::endl;
+		return false;
+	}
+
+	SDL_LockSurface(surface);
+	load_from_pixels((const uint32_t *)surface->pixels, surface->w, surface->h, surface->pitch);
+	SDL_UnlockSurface(surface);
+	SDL_FreeSurface(surface);
 	return true;
 }
 
-void texture::get_pixel(int x, int y, uint8_t &r, uint8_t &g, uint8_t &b) const
+void texture::load_from_pixels(const uint32_t *pixels, int w, int h, int pitch)
 {
-	// NOTE: Is the max indexable pixel at (w, h) or (w-1, h-1)?
-	assert(x <= surface->w && x >= 0);
-	assert(y <= surface->h && y >= 0);
+	// non power of two images are resampled to the next power of two
+	mip base;
+	base.offset = 0;
+	base.w = pow2_ceil(w);
+	base.h = pow2_ceil(h);
+	base.mask_x = base.w - 1;
+	base.mask_y = base.h - 1;
+	base.row_shift = log2_int(base.w) + 2;
 
-	int bpp = surface->format->BytesPerPixel;
-	Uint8 *p = (Uint8 *)surface->pixels + y * surface->pitch + x * bpp;
+	mips.assign(1, base);
+	texels.assign((size_t)base.w * base.h, 0);
 
-	Uint32 pixel;
-	switch (bpp)
+	for_range(y, 0, base.h)
 	{
-		case 1:
-			pixel = *p;
-			break;
-
-		case 2:
-			pixel = *(Uint16 *)p;
-			break;
-
-		case 3:
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-			pixel = p[0] << 16 | p[1] << 8 | p[2];
-#else
-			pixel = p[0] | p[1] << 8 | p[2] << 16;
-#endif
-			break;
-
-		case 4:
-			pixel = *(Uint32 *)p;
-			break;
-
-		default:
-			assert(false && "Unreachable");
+		const int src_y = (int)((int64_t)y * h / base.h);
+		const uint32_t *row = (const uint32_t *)((const uint8_t *)pixels + src_y * pitch);
+
+		for_range(x, 0, base.w)
+		{
+			const int src_x = (int)((int64_t)x * w / base.w);
+			texels[base.index(x, y)] = row[src_x] | 0xff000000;
+		}
 	}
 
-	SDL_GetRGB(pixel, surface->format, &r, &g, &b);
+	build_mips();
+}
+
+void texture::build_mips()
+{
+	while (mips.back().w > 4 || mips.back().h > 4)
+	{
+		const mip src = mips.back();
+
+		mip dst;
+		dst.offset = texels.size();
+		dst.w = std::max(src.w / 2, 4);
+		dst.h = std::max(src.h / 2, 4);
+		dst.mask_x = dst.w - 1;
+		dst.mask_y = dst.h - 1;
+		dst.row_shift = log2_int(dst.w) + 2;
+
+		texels.resize(texels.size() + (size_t)dst.w * dst.h);
+
+		// a dimension already at 4 is not halved again
+		const int step_x = src.w / dst.w;
+		const int step_y = src.h / dst.h;
+
+		for_range(y, 0, dst.h)
+		{
+			for_range(x, 0, dst.w)
+			{
+				const int sx = x * step_x, sy = y * step_y;
+				const uint32_t box[4] = {
+					texels[src.offset + src.index(sx, sy)],
+					texels[src.offset + src.index(sx + step_x - 1, sy)],
+					texels[src.offset + src.index(sx, sy + step_y - 1)],
+					texels[src.offset + src.index(sx + step_x - 1, sy + step_y - 1)],
+				};
+
+				uint32_t texel = 0;
+				for (int shift = 0; shift < 32; shift += 8)
+				{
+					uint32_t sum = 2;
+					for (auto t : box) sum += (t >> shift) & 0xff;
+					texel |= (sum / 4) << shift;
+				}
+				texels[dst.offset + dst.index(x, y)] = texel;
+			}
+		}
+
+		mips.push_back(dst);
+	}
+}
+
+int texture::lod(float texel_area, float screen_area) const
+{
+	if (!(texel_area > screen_area)) return 0;
+
+	// each level halves both dimensions, so a level covers 4 times the area
+	const int level = (int)(0.5f * log2f(texel_area / screen_area));
+	return std::min(level, levels() - 1);
 }
@@ -1,24 +1,73 @@
 #pragma once
 
 #include <SDL2/SDL.h>
+#include <cmath>
+#include <cstdint>
+#include <vector>
 
+// Texels are converted once at load time to the framebuffer format (ARGB8888)
+// and stored in 4x4 tiles, so one tile fills a 64 byte cache line and texels
+// that are close in both directions are close in memory. The size is rounded
+// up to powers of two so coordinates wrap with a mask.
+// A box filtered mip chain down to 4x4 is built at load time.
 class texture
 {
 public:
 	bool load_from_file(const char *path);
 
-	void get_pixel(int x, int y, uint8_t &r, uint8_t &g, uint8_t &b) const;
+	// ARGB8888 rows pitch bytes apart, alpha is ignored
+	void load_from_pixels(const uint32_t *pixels, int w, int h, int pitch);
 
-	int width() const
+	// repeat addressing, x and y are wrapped to the level size
+	uint32_t texel(int x, int y, int level = 0) const
 	{
-		return surface->w;
+		const mip &m = mips[level];
+		return texels[m.offset + m.index(x & m.mask_x, y & m.mask_y)];
 	}
 
-	int height() const
+	// nearest texel, u and v in [0, 1) cover the whole texture. Floored, truncation would
+	// map both sides of 0 onto texel 0 and stretch it over a seam.
+	uint32_t sample(float u, float v, int level = 0) const
 	{
-		return surface->h;
+		const mip &m = mips[level];
+		return texel((int)floorf(u * (float)m.w), (int)floorf(v * (float)m.h), level);
+	}
+
+	// mip level for a triangle covering texel_area texels of level 0 on screen_area pixels
+	int lod(float texel_area, float screen_area) const;
+
+	int levels() const
+	{
+		return mips.size();
+	}
+
+	int width(int level = 0) const
+	{
+		return mips[level].w;
+	}
+
+	int height(int level = 0) const
+	{
+		return mips[level].h;
 	}
 
 private:
-	SDL_Surface *surface;
+	struct mip {
+		size_t offset;
+		int w, h;
+		int mask_x, mask_y;
+		// log2 of the texels in a row of tiles
+		int row_shift;
+
+		size_t index(int x, int y) const
+		{
+			return ((y >> 2) << row_shift) + ((x >> 2) << 4) + ((y & 3) << 2) + (x & 3);
+		}
+	};
+
+	// all levels back to back, level 0 first
+	std::vector<uint32_t> texels;
+	std::vector<mip> mips;
+
+	void build_mips();
 };
@@ -142,3 +142,116 @@ int triangle::clip_plane(vec3 plane_point, vec3 plane_normal, triangle &in, tria
 			assert(false && "Unreachable");
 	}
 }
+
+namespace
+{
+	struct clip_vertex {
+		vec3 v;
+		vec2 t;
+	};
+
+	// signed distance to a frustum plane, positive inside
+	float frustum_distance(const vec3 &v, int plane, float guard_x, float guard_y)
+	{
+		switch (plane)
+		{
+			case 0: return v.z;
+			case 1: return v.w - v.z;
+			case 2: return guard_x * v.w + v.x;
+			case 3: return guard_x * v.w - v.x;
+			case 4: return guard_y * v.w + v.y;
+			case 5: return guard_y * v.w - v.y;
+			default:
+				assert(false && "Unreachable");
+				return 0.0f;
+		}
+	}
+
+	// one bit per plane the vertex is outside of
+	int frustum_outcode(const vec3 &v, float guard_x, float guard_y)
+	{
+		int outcode = 0;
+		for_range(plane, 0, 6)
+		{
+			if (frustum_distance(v, plane, guard_x, guard_y) < 0.0f) outcode |= 1 << plane;
+		}
+		return outcode;
+	}
+
+	clip_vertex clip_lerp(const clip_vertex &a, const clip_vertex &b, float t)
+	{
+		clip_vertex r;
+		r.v.x = a.v.x + (b.v.x - a.v.x) * t;
+		r.v.y = a.v.y + (b.v.y - a.v.y) * t;
+		r.v.z = a.v.z + (b.v.z - a.v.z) * t;
+		r.v.w = a.v.w + (b.v.w - a.v.w) * t;
+		r.t.u = a.t.u + (b.t.u - a.t.u) * t;
+		r.t.v = a.t.v + (b.t.v - a.t.v) * t;
+		r.t.w = a.t.w + (b.t.w - a.t.w) * t;
+		return r;
+	}
+}
+
+int triangle::clip_frustum(const triangle &in, triangle out[CLIP_MAX], float guard_x, float guard_y)
+{
+	int viewport[3], guard[3];
+	for_range(i, 0, 3)
+	{
+		viewport[i] = frustum_outcode(in.vs[i], 1.0f, 1.0f);
+		guard[i] = guard_x == 1.0f && guard_y == 1.0f ? viewport[i] : frustum_outcode(in.vs[i], guard_x, guard_y);
+	}
+
+	// all vertices outside of the same plane
+	if (viewport[0] & viewport[1] & viewport[2]) return 0;
+
+	// inside the guard band the rasterizer scissors to the viewport
+	const int crossed = guard[0] | guard[1] | guard[2];
+	if (crossed == 0)
+	{
+		out[0] = in;
+		return 1;
+	}
+
+	clip_vertex buf[2][9];
+	for_range(i, 0, 3) buf[0][i] = {in.vs[i], in.ts[i]};
+
+	int n = 3;
+	int src = 0;
+	for_range(plane, 0, 6)
+	{
+		if (!(crossed & (1 << plane))) continue;
+
+		const clip_vertex *poly = buf[src];
+		clip_vertex *clipped = buf[src ^ 1];
+		int m = 0;
+
+		for_range(i, 0, n)
+		{
+			const clip_vertex &cur = poly[i];
+			const clip_vertex &next = poly[(i + 1) % n];
+
+			const float d_cur = frustum_distance(cur.v, plane, guard_x, guard_y);
+			const float d_next = frustum_distance(next.v, plane, guard_x, guard_y);
+
+			if (d_cur >= 0.0f) clipped[m++] = cur;
+			if ((d_cur >= 0.0f) != (d_next >= 0.0f)) clipped[m++] = clip_lerp(cur, next, d_cur / (d_cur - d_next));
+		}
+
+		n = m;
+		src ^= 1;
+		if (n < 3) return 0;
+	}
+
+	const clip_vertex *poly = buf[src];
+	for_range(i, 0, n - 2)
+	{
+		out[i].vs[0] = poly[0].v;
+		out[i].ts[0] = poly[0].t;
+		out[i].vs[1] = poly[i + 1].v;
+		out[i].ts[1] = poly[i + 1].t;
+		out[i].vs[2] = poly[i + 2].v;
+		out[i].ts[2] = poly[i + 2].t;
+		out[i].color = in.color;
+	}
+	return n - 2;
+}
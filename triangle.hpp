@@ -18,4 +18,12 @@ struct triangle {
 	}
 
 	static int clip_plane(vec3 plane_point, vec3 plane_normal, triangle &in, triangle &out1, triangle &out2);
+
+	// Sutherland-Hodgman clipping of a clip space triangle (before the perspective divide)
+	// against the six frustum planes -w <= x, y <= w and 0 <= z <= w.
+	// The polygon has at most 9 vertices and is returned as a fan of up to CLIP_MAX triangles.
+	// With a guard band the side planes are pushed out to -guard_x * w <= x <= guard_x * w
+	// (same for y), triangles outside of the viewport are still rejected.
+	static const int CLIP_MAX = 7;
+	static int clip_frustum(const triangle &in, triangle out[CLIP_MAX], float guard_x = 1.0f, float guard_y = 1.0f);
 };